@@ -0,0 +1,278 @@
+(ns pharaoh.bench
+  (:require [clojure.edn :as edn]
+            [clojure.string :as str]
+            [pharaoh.contracts :as ct]
+            [pharaoh.economy :as ec]
+            [pharaoh.random :as r]
+            [pharaoh.simulation :as sim]
+            [pharaoh.tables :as tables]
+            [pharaoh.timelapse :as tl]
+            [pharaoh.transactions :as tx]
+            [pharaoh.util :as util]
+            [pharaoh.world :as world])
+  (:import [java.lang.management ManagementFactory GarbageCollectorMXBean]
+           [java.util Arrays Locale])
+  (:gen-class))
+
+;; Microbenchmarks for the engine's hot paths, named after the C
+;; routines they stand for. Each benchmark builds its input once from a
+;; fixed seed, is warmed up, then timed in batches sized to take about
+;; batch-ms each; the figures are per call, in nanoseconds, over the
+;; batches. The JVM gives no access to the CPU's own counters, so the
+;; counters reported are the ones it does keep: thread CPU time, bytes
+;; allocated by the benchmark thread, and collector runs.
+;;
+;; Results are JSON:
+;;   {"jvm": ..., "benchmarks": [{"name": "RunMonth/early",
+;;     "median_ns": ..., "mean_ns": ..., "p90_ns": ..., "min_ns": ...,
+;;     "stddev_ns": ..., "ops": ..., "cpu_ns_per_op": ...,
+;;     "alloc_bytes_per_op": ..., "gc_count": ..., "gc_ms": ...}]}
+;; and a run given a baseline file flags every benchmark whose median
+;; grew by more than the threshold.
+
+(def ^:private sink (object-array 1))
+
+(defn- late-game [months]
+  (let [rng (r/make-rng 42)]
+    (loop [state (tl/new-game rng "Easy") m 0]
+      (if (or (>= m months) (:game-over state) (:game-won state))
+        state
+        (recur (tl/batch-month rng (:state (tx/apply-orders rng state (world/default-policy state))))
+               (inc m))))))
+
+(defn- with-pending [state]
+  (let [offers (:cont-offers (ct/new-offers (r/make-rng 7) state))]
+    (assoc state :cont-pend (mapv #(assoc % :active true) offers))))
+
+;; Each :setup returns the input; :op is called with the rng and it.
+(def benchmarks
+  [{:name "RunMonth/early"
+    :setup #(tl/new-game (r/make-rng 42) "Normal")
+    :op sim/run-month}
+   {:name "RunMonth/late"
+    :setup #(late-game 300)
+    :op sim/run-month}
+   {:name "interpolate"
+    :setup (constantly nil)
+    :op (fn [rng _] (tables/interpolate (r/uniform rng -1.0 13.0) tables/seasonal-yield))}
+   {:name "URandom"
+    :setup (constantly nil)
+    :op (fn [rng _] (r/uniform rng 0.0 1.0))}
+   {:name "GRandom"
+    :setup (constantly nil)
+    :op (fn [rng _] (r/gaussian rng 0.0 1.0))}
+   {:name "ARandom"
+    :setup (constantly nil)
+    :op (fn [rng _] (r/abs-gaussian rng 0.0 1.0))}
+   {:name "AdjustProduction"
+    :setup #(let [s (late-game 120)]
+              [{:supply (get-in s [:supply :wheat]) :demand (get-in s [:demand :wheat])
+                :production (get-in s [:production :wheat]) :price (get-in s [:prices :wheat])}
+               (:world-growth s)])
+    :op (fn [rng [market growth]] (ec/adjust-production rng market growth))}
+   {:name "NewOffers"
+    :setup #(late-game 120)
+    :op ct/new-offers}
+   {:name "ContProg"
+    :setup #(with-pending (late-game 120))
+    :op ct/contract-progress}
+   {:name "SymDump"
+    :setup #(late-game 300)
+    :op (fn [_ state] (pr-str state))}
+   {:name "SymLoad"
+    :setup #(pr-str (late-game 300))
+    :op (fn [_ s] (edn/read-string s))}
+   {:name "FmtFloat"
+    :setup (constantly nil)
+    :op (fn [rng _] (util/fmt-float (r/uniform rng 0.0 1e7)))}])
+
+(defn- thread-mx []
+  (let [mx (ManagementFactory/getThreadMXBean)]
+    (when (and (instance? com.sun.management.ThreadMXBean mx)
+               (.isThreadAllocatedMemorySupported ^com.sun.management.ThreadMXBean mx))
+      mx)))
+
+(defn- allocated ^long [mx]
+  (if mx
+    (.getThreadAllocatedBytes ^com.sun.management.ThreadMXBean mx
+                              (.getId (Thread/currentThread)))
+    -1))
+
+(defn- gc-totals []
+  (reduce (fn [[n ms] ^GarbageCollectorMXBean b]
+            [(+ n (max 0 (.getCollectionCount b))) (+ ms (max 0 (.getCollectionTime b)))])
+          [0 0] (ManagementFactory/getGarbageCollectorMXBeans)))
+
+(defn- time-batch ^long [op rng input ^long n]
+  (let [t0 (System/nanoTime)]
+    (dotimes [_ n] (aset sink 0 (op rng input)))
+    (- (System/nanoTime) t0)))
+
+;; Doubles the batch size until one batch takes batch-ms.
+(defn- calibrate [op rng input batch-ms]
+  (loop [n 1]
+    (if (or (>= (time-batch op rng input n) (* batch-ms 1000000)) (>= n (bit-shift-left 1 30)))
+      n
+      (recur (* 2 n)))))
+
+(defn- percentile [^doubles sorted p]
+  (aget sorted (min (dec (alength sorted)) (long (* p (alength sorted))))))
+
+(defn measure [{:keys [setup op]} {:keys [batches batch-ms warmup-ms]
+                                   :or {batches 20 batch-ms 50 warmup-ms 1000}}]
+  (let [rng (r/make-rng 42)
+        input (setup)
+        warm-until (+ (System/nanoTime) (* warmup-ms 1000000))
+        _ (while (< (System/nanoTime) warm-until) (time-batch op rng input 64))
+        n (calibrate op rng input batch-ms)
+        mx (thread-mx)
+        threads (ManagementFactory/getThreadMXBean)
+        [gc0 gc-ms0] (gc-totals)
+        a0 (allocated mx)
+        cpu0 (.getCurrentThreadCpuTime threads)
+        per-op (double-array (repeatedly batches #(/ (time-batch op rng input n) (double n))))
+        cpu1 (.getCurrentThreadCpuTime threads)
+        a1 (allocated mx)
+        [gc1 gc-ms1] (gc-totals)
+        ops (* n batches)
+        mean (/ (areduce per-op i s 0.0 (+ s (aget per-op i))) batches)
+        sorted (doto (aclone per-op) (Arrays/sort))]
+    {:median_ns (percentile sorted 0.5)
+     :mean_ns mean
+     :p90_ns (percentile sorted 0.9)
+     :min_ns (aget sorted 0)
+     :stddev_ns (Math/sqrt (/ (areduce per-op i s 0.0
+                                       (+ s (Math/pow (- (aget per-op i) mean) 2)))
+                              batches))
+     :ops ops
+     :cpu_ns_per_op (/ (- cpu1 cpu0) (double ops))
+     :alloc_bytes_per_op (when mx (/ (- a1 a0) (double ops)))
+     :gc_count (- gc1 gc0)
+     :gc_ms (- gc-ms1 gc-ms0)}))
+
+(defn run [names opts]
+  (vec (for [b benchmarks
+             :when (or (empty? names) (contains? names (:name b)))]
+         (do (binding [*out* *err*] (println "running" (:name b)))
+             (assoc (measure b opts) :name (:name b))))))
+
+;; JSON: just the subset written here (maps, sequences, strings,
+;; numbers, booleans and null).
+
+(defn- json-str [^String s]
+  (str "\"" (str/escape s {\" "\\\"" \\ "\\\\" \newline "\\n" \tab "\\t" \return "\\r"}) "\""))
+
+(defn write-json [x]
+  (cond
+    (nil? x) "null"
+    (boolean? x) (str x)
+    (map? x) (str "{" (str/join ", " (for [[k v] x] (str (json-str (name k)) ": " (write-json v)))) "}")
+    (sequential? x) (str "[" (str/join ",\n " (map write-json x)) "]")
+    (and (float? x) (or (Double/isNaN x) (Double/isInfinite x))) "null"
+    (float? x) (String/format Locale/ROOT "%.3f" (object-array [(double x)]))
+    (number? x) (str x)
+    :else (json-str (str x))))
+
+(defn- skip-ws [^String s i]
+  (loop [i i]
+    (if (and (< i (count s)) (Character/isWhitespace (.charAt s i))) (recur (inc i)) i)))
+
+(def ^:private number-chars (set "+-.0123456789eE"))
+
+(declare read-value)
+
+(defn- read-string-at [^String s i]
+  (let [sb (StringBuilder.)]
+    (loop [i (inc i)]
+      (let [c (.charAt s i)]
+        (case c
+          \" [(str sb) (inc i)]
+          \\ (let [e (.charAt s (inc i))]
+               (if (= e \u)
+                 (do (.append sb (char (Integer/parseInt (subs s (+ i 2) (+ i 6)) 16)))
+                     (recur (+ i 6)))
+                 (do (.append sb (get {\n \newline \t \tab \r \return \b \backspace \f \formfeed} e e))
+                     (recur (+ i 2)))))
+          (do (.append sb c) (recur (inc i))))))))
+
+(defn- read-seq [^String s i close item]
+  (loop [i (skip-ws s (inc i)) acc []]
+    (if (= close (.charAt s i))
+      [acc (inc i)]
+      (let [[v i] (item s i)
+            i (skip-ws s i)]
+        (recur (skip-ws s (if (= \, (.charAt s i)) (inc i) i)) (conj acc v))))))
+
+(defn- read-value [^String s i]
+  (let [i (skip-ws s i)
+        c (.charAt s i)]
+    (cond
+      (= c \{) (let [[kvs i] (read-seq s i \}
+                                       (fn [s i]
+                                         (let [[k i] (read-string-at s (skip-ws s i))
+                                               [v i] (read-value s (inc (skip-ws s i)))]
+                                           [[(keyword k) v] i])))]
+                 [(into {} kvs) i])
+      (= c \[) (read-seq s i \] read-value)
+      (= c \") (read-string-at s i)
+      (.startsWith s "true" i) [true (+ i 4)]
+      (.startsWith s "false" i) [false (+ i 5)]
+      (.startsWith s "null" i) [nil (+ i 4)]
+      :else (let [end (loop [j i]
+                        (if (and (< j (count s)) (number-chars (.charAt s j)))
+                          (recur (inc j)) j))]
+              [(edn/read-string (subs s i end)) end]))))
+
+(defn read-json [s]
+  (first (read-value s 0)))
+
+;; Each benchmark in both runs, with its change in median; :regressed
+;; when it grew by more than threshold (a fraction).
+(defn compare-runs [baseline current threshold]
+  (let [before (into {} (map (juxt :name :median_ns)) baseline)]
+    (vec (for [{:keys [name median_ns]} current
+               :let [old (before name)]
+               :when old]
+           {:name name :baseline_ns old :median_ns median_ns
+            :change (- (/ median_ns old) 1.0)
+            :regressed (> median_ns (* old (+ 1.0 threshold)))}))))
+
+(defn- jvm-info []
+  {:java (System/getProperty "java.version")
+   :vm (System/getProperty "java.vm.name")
+   :os (str (System/getProperty "os.name") " " (System/getProperty "os.arch"))
+   :cpus (.availableProcessors (Runtime/getRuntime))})
+
+(defn- parse-args [args]
+  (into {} (map (fn [[k v]] [(keyword (str/replace k #"^--" "")) v])
+                (partition 2 args))))
+
+;; clojure -M:bench [--only RunMonth/late,URandom] [--batches N]
+;;                  [--batch-ms N] [--warmup-ms N] [--out FILE]
+;;                  [--baseline FILE [--threshold PERCENT]]
+;; With --baseline, exits 1 if any benchmark regressed.
+(defn -main [& args]
+  (let [{:keys [only batches batch-ms warmup-ms out baseline threshold]} (parse-args args)
+        parse #(when % (Long/parseLong %))
+        results (run (if only (set (str/split only #",")) #{})
+                     (cond-> {}
+                       batches (assoc :batches (parse batches))
+                       batch-ms (assoc :batch-ms (parse batch-ms))
+                       warmup-ms (assoc :warmup-ms (parse warmup-ms))))
+        report {:jvm (jvm-info) :benchmarks results}]
+    (doseq [{:keys [name median_ns p90_ns alloc_bytes_per_op]} results]
+      (println (format "%-18s %14.1f ns %14.1f ns p90 %12s B/op" name median_ns p90_ns
+                       (if alloc_bytes_per_op (format "%.0f" alloc_bytes_per_op) "-"))))
+    (when out (spit out (str (write-json report) "\n")))
+    (let [regressed (when baseline
+                      (let [t (/ (Double/parseDouble (or threshold "10")) 100.0)
+                            rows (compare-runs (:benchmarks (read-json (slurp baseline)))
+                                               results t)]
+                        (println)
+                        (doseq [{:keys [name baseline_ns median_ns change regressed]} rows]
+                          (println (format "%-18s %14.1f -> %14.1f ns %+7.1f%%%s" name baseline_ns
+                                           median_ns (* 100 change) (if regressed "  REGRESSED" ""))))
+                        (filter :regressed rows)))]
+      (shutdown-agents)
+      (when (seq regressed)
+        (System/exit 1)))))
@@ -0,0 +1,86 @@
+(ns pharaoh.autorun
+  (:require [pharaoh.simulation :as sim]))
+
+;; Run-until mode. DoRun stopped for every alert and repainted after each
+;; month. Here months run back to back, alerts collect in :alert-log, and
+;; the screen redraws at the frame rate while the run is in progress.
+;; When the run stops, the log is queued for review behind a summary.
+
+(def frame-budget-ms 20)
+
+(defn start [state {:keys [months cash-below contract-due]
+                    :or {months 12}}]
+  (assoc state
+    :autorun {:months-left months :months-run 0
+              :cash-below cash-below :contract-due contract-due}
+    :alert-log []))
+
+(defn- contract-due? [state]
+  (some #(and (:active %) (<= (:duration %) 1)) (:cont-pend state)))
+
+(defn stop-reason [state {:keys [months-left cash-below contract-due]}]
+  (cond
+    (:game-over state) :game-over
+    (:game-won state) :pyramid-done
+    (and cash-below (< (:gold state) cash-below)) :cash-below
+    (and contract-due (contract-due? state)) :contract-due
+    (<= months-left 0) :months))
+
+;; Foreclosure stays on screen; it ends the game when dismissed.
+(defn- log-alerts [state]
+  (let [stamp #(assoc % :year (:year state) :month (:month state))
+        keep-msg? (:game-over state)
+        msg (:message state)
+        alerts (cond-> []
+                 (:notice state) (conj (:notice state))
+                 (and (map? msg) (not keep-msg?)) (conj msg)
+                 true (into (:contract-msgs state)))]
+    (cond-> (-> state
+                (dissoc :notice)
+                (assoc :contract-msgs [])
+                (update :alert-log into (map stamp alerts)))
+      (not keep-msg?) (dissoc :message))))
+
+(defn- summary [reason {:keys [months-run cash-below]} n]
+  (str (case reason
+         :months (format "Ran %d months." months-run)
+         :cash-below (format "Stopped after %d months: gold fell below %.0f."
+                             months-run (double cash-below))
+         :contract-due (format "Stopped after %d months: a contract is due."
+                               months-run)
+         :pyramid-done (format "Stopped after %d months: the pyramid is complete."
+                               months-run)
+         :cancelled (format "Stopped after %d months." months-run))
+       (when (pos? n) (format " %d messages to review." n))))
+
+(defn- finish [state reason]
+  (let [log (:alert-log state)
+        run (:autorun state)
+        state (-> state
+                  (dissoc :autorun :alert-log)
+                  (update :contract-msgs #(into (vec log) %)))]
+    (if (:message state)
+      state
+      (assoc state :message {:text (summary reason run (count log))}))))
+
+(defn cancel [state]
+  (if (:autorun state) (finish state :cancelled) state))
+
+(defn step [rng state]
+  (let [state (-> (sim/advance rng state)
+                  (update-in [:autorun :months-left] dec)
+                  (update-in [:autorun :months-run] inc)
+                  log-alerts)]
+    (if-let [reason (stop-reason state (:autorun state))]
+      (finish state reason)
+      state)))
+
+;; Steps months until the run stops or the frame's time is used up. At
+;; least one month runs per frame.
+(defn run-frame
+  ([rng state] (run-frame rng state (+ (System/currentTimeMillis) frame-budget-ms)))
+  ([rng state deadline]
+   (loop [state (step rng state)]
+     (if (and (:autorun state) (< (System/currentTimeMillis) deadline))
+       (recur (step rng state))
+       state))))
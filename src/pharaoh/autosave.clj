@@ -0,0 +1,38 @@
+(ns pharaoh.autosave
+  (:require [pharaoh.persistence :as ps]))
+
+;; Autosave is a timed job like the visits, but it does not wait behind
+;; dialogs, messages or menus. A dialog's half-typed quantity lives in
+;; :dialog, so the rest of the state is always the last committed game,
+;; and that is what gets written. An agent does the writing so the event
+;; loop never waits on the disk.
+
+(def interval-ms 60000)
+(def file-name "autosave")
+
+(def ^:private writer (agent nil))
+
+(defn init-timer [now]
+  {:next-autosave (+ now interval-ms)})
+
+(defn- snapshot [state]
+  (dissoc state :dialog :dirty :save-path :pending-action))
+
+(defn next-save [{:keys [state] :as app} _now]
+  (when (and (:dirty state) (not (:game-over state)))
+    (:next-autosave app)))
+
+(defn save! [state path]
+  (send-off writer (fn [_]
+                     (ps/ensure-saves-dir)
+                     (ps/save-game state path)
+                     path)))
+
+(defn run [{:keys [state autosaved] :as app} now]
+  (let [snap (snapshot state)]
+    (when-not (= snap autosaved)
+      (save! snap (ps/save-path file-name)))
+    (assoc app :autosaved snap :next-autosave (+ now interval-ms))))
+
+(defn await-writes []
+  (await writer))
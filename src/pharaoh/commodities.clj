@@ -0,0 +1,60 @@
+(ns pharaoh.commodities
+  (:require [pharaoh.economy :as ec]))
+
+;; C: the WHEAT..LAND codes of contract.h, with what PtrWhat,
+;; PtrHealthWhat and TextWhat looked up for each. A row's index is its
+;; code. :amount is the state key holding the stock (land trades from
+;; fallow), :health the key of its health if it has one. Market data
+;; lives in the state's :prices, :supply, :demand and :production maps,
+;; keyed by :key. A new commodity is a new row plus its place in the two
+;; orders below.
+(def table
+  [{:key :wheat  :amount :wheat     :health nil        :name "wheat"}
+   {:key :slaves :amount :slaves    :health :sl-health :name "slaves"}
+   {:key :oxen   :amount :oxen      :health :ox-health :name "oxen"}
+   {:key :horses :amount :horses    :health :hs-health :name "horses"}
+   {:key :manure :amount :manure    :health nil        :name "manure"}
+   {:key :land   :amount :ln-fallow :health nil        :name "land"}])
+
+(def codes (mapv :key table))
+
+(def ^:private by-key (into {} (map (juxt :key identity)) table))
+
+(defn code [k]
+  (.indexOf ^java.util.List codes k))
+
+(defn amount-key [k]
+  (get-in by-key [k :amount]))
+
+(defn health-key [k]
+  (get-in by-key [k :health]))
+
+;; C: TextWhat, the commodity's name in messages.
+(defn text [k]
+  (get-in by-key [k :name]))
+
+;; C: RunMonth walks the prices, then calls AdjustProduction, each in
+;; its own order. Both draw from the rng, so the orders are kept.
+(def price-order [:wheat :land :horses :oxen :slaves :manure])
+(def market-order [:wheat :manure :slaves :horses :oxen :land])
+
+(defn update-prices [rng market inflation]
+  (reduce (fn [m k] (update-in m [:prices k] #(ec/update-price rng % inflation)))
+          market price-order))
+
+;; C: the six AdjustProduction calls. market is any map with :prices,
+;; :supply, :demand and :production, such as the game state.
+(defn adjust-markets [rng market world-growth]
+  (reduce (fn [m k]
+            (let [result (ec/adjust-production
+                           rng {:supply (get-in m [:supply k])
+                                :demand (get-in m [:demand k])
+                                :production (get-in m [:production k])
+                                :price (get-in m [:prices k])}
+                           world-growth)]
+              (-> m
+                  (assoc-in [:supply k] (:supply result))
+                  (assoc-in [:demand k] (:demand result))
+                  (assoc-in [:production k] (:production result))
+                  (assoc-in [:prices k] (:price result)))))
+          market market-order))
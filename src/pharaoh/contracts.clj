@@ -1,5 +1,6 @@
 (ns pharaoh.contracts
-  (:require [pharaoh.messages :as msg]
+  (:require [pharaoh.commodities :as cm]
+            [pharaoh.messages :as msg]
             [pharaoh.random :as r]
             [pharaoh.state :as st]))
 
@@ -7,28 +8,21 @@
 (def max-pend 10)
 (def max-players 10)
 
-(def commodities [:wheat :slaves :oxen :horses :manure :land])
+(def commodities cm/codes)
 
-(defn make-players [rng]
-  (vec (for [i (range max-players)]
-         {:pay-k (r/max-random rng 2 0.5 1.0)
-          :ship-k (r/max-random rng 2 0.5 1.0)
-          :default-k (r/max-random rng 5 0.95 1.0)
-          :name (get msg/player-names i
-                     (str "King " i))})))
-
-(defn- commodity-ptr [what]
-  (case what
-    :wheat :wheat :slaves :slaves :oxen :oxen
-    :horses :horses :manure :manure :land :ln-fallow))
-
-(defn- health-ptr [what]
-  (case what
-    :slaves :sl-health :oxen :ox-health :horses :hs-health nil))
+(defn make-players
+  ([rng] (make-players rng max-players))
+  ([rng n]
+   (vec (for [i (range n)]
+          {:pay-k (r/max-random rng 2 0.5 1.0)
+           :ship-k (r/max-random rng 2 0.5 1.0)
+           :default-k (r/max-random rng 5 0.95 1.0)
+           :name (get msg/player-names i
+                      (str "King " i))}))))
 
 (defn inc-commodity [state what added]
-  (let [ptr (commodity-ptr what)
-        h-ptr (health-ptr what)
+  (let [ptr (cm/amount-key what)
+        h-ptr (cm/health-key what)
         existing (get state ptr 0.0)]
     (if (and h-ptr (pos? added))
       (let [old-h (get state h-ptr 0.8)
@@ -56,7 +50,7 @@
         (if (already-trading? offers pending who what)
           (recur (inc tries))
           (let [typ (if (< (r/uniform rng 0.0 1.0) 0.5) :buy :sell)
-                ptr (commodity-ptr what)
+                ptr (cm/amount-key what)
                 stock (get state ptr 0.0)
                 unit-price (get-in state [:prices what] 100.0)
                 min-amount (/ 200000.0 unit-price)
@@ -115,12 +109,22 @@
   (let [name (get-in players [(:who contract)] {:name "Unknown"})
         name (if (string? name) name (:name name))]
     (str "Regarding your contract with " name
-         " for " (long (:amount contract)) " " (clojure.core/name (:what contract))
+         " for " (long (:amount contract)) " " (cm/text (:what contract))
          ": " pool-msg)))
 
+;; Message pool for each settlement outcome.
+(def outcome-messages
+  {:insufficient-goods msg/contract-insufficient-goods-messages
+   :partial-pay        msg/contract-partial-pay-messages
+   :buy-complete       msg/buy-complete-messages
+   :insufficient-funds msg/contract-insufficient-funds-messages
+   :partial-ship       msg/contract-partial-ship-messages
+   :complete           msg/contract-complete-messages
+   :default            msg/contract-default-messages})
+
 ;; C: ContProg BUY settlement — ppu = price/amount, C-exact math
 (defn- settle-buy [rng state contract player]
-  (let [ptr (commodity-ptr (:what contract))
+  (let [ptr (cm/amount-key (:what contract))
         amount (:amount contract)
         price (:price contract)
         ppu (/ price amount)
@@ -135,7 +139,7 @@
                     (update :gold + (* my-amount ppu))
                     (update :gold - (* 0.1 new-price)))
          :contract (assoc contract :price new-price :amount new-amount)
-         :msg-pool msg/contract-insufficient-goods-messages})
+         :outcome :insufficient-goods})
 
       (< can-buy amount)
       (let [new-price (* price (- 1.0 (/ can-buy amount)))
@@ -143,12 +147,12 @@
         {:state (-> state (update ptr - can-buy)
                     (update :gold + (* can-buy ppu) (* 0.1 new-price)))
          :contract (assoc contract :price new-price :amount new-amount)
-         :msg-pool msg/contract-partial-pay-messages})
+         :outcome :partial-pay})
 
       :else
       {:state (-> state (update ptr - can-buy) (update :gold + price))
        :contract (assoc contract :active false)
-       :msg-pool msg/buy-complete-messages})))
+       :outcome :buy-complete})))
 
 ;; C: ContProg SELL settlement — ppu = price/amount, C-exact math
 (defn- settle-sell [rng state contract player]
@@ -170,7 +174,7 @@
                     (inc-commodity what my-amount)
                     (assoc :gold (- gold-after (* my-amount ppu))))
          :contract (assoc contract :price new-price :amount new-amount)
-         :msg-pool msg/contract-insufficient-funds-messages})
+         :outcome :insufficient-funds})
 
       (< can-sell amount)
       (let [new-price (* price (- 1.0 (/ can-sell amount)))
@@ -180,13 +184,27 @@
                     (update :gold - (* can-sell ppu))
                     (inc-commodity what can-sell))
          :contract (assoc contract :price new-price :amount new-amount)
-         :msg-pool msg/contract-partial-ship-messages})
+         :outcome :partial-ship})
 
       :else
       {:state (-> state (inc-commodity what amount)
                   (update :gold - price))
        :contract (assoc contract :active false)
-       :msg-pool msg/contract-complete-messages})))
+       :outcome :complete})))
+
+;; Settles a contract that has come due.
+(defn settle [rng state contract player]
+  (if (= :buy (:type contract))
+    (settle-buy rng state contract player)
+    (settle-sell rng state contract player)))
+
+;; Months until ContProg's first default, when each month's check
+;; defaults with probability 1 - default-k; nil when it never does. A
+;; contract with d months to run defaults iff this is <= d.
+(defn months-to-default [rng default-k]
+  (when (< default-k 1.0)
+    (inc (long (Math/floor (/ (Math/log (- 1.0 (r/uniform rng 0.0 1.0)))
+                              (Math/log default-k)))))))
 
 ;; C: ContProg — default check, then --duration <= 0 triggers settlement
 (defn fulfill-contract [rng state contract players]
@@ -195,15 +213,15 @@
     (if defaults?
       {:state (update state :gold + (* (:price contract) 0.05))
        :contract (assoc contract :active false)
-       :msg-pool msg/contract-default-messages}
+       :outcome :default}
       (let [dur (dec (:duration contract))
             contract (assoc contract :duration dur)]
         (if (<= dur 0)
-          (if (= :buy (:type contract))
-            (settle-buy rng state contract player)
-            (settle-sell rng state contract player))
+          (settle rng state contract player)
           {:state state :contract contract})))))
 
+;; C: ContMsg — queues a notice holding the draw that picks the wording;
+;; pharaoh.notices builds the text when the notice is shown.
 (defn contract-progress [rng state]
   (let [players (:players state)]
     (loop [pend (:cont-pend state)
@@ -217,11 +235,13 @@
         (let [c (nth pend idx)]
           (if (not (:active c))
             (recur pend (inc idx) s (conj new-pend c) msgs)
-            (let [{:keys [state contract msg-pool]}
+            (let [{:keys [state contract outcome]}
                   (fulfill-contract rng s c players)
-                  msgs (if msg-pool
-                         (let [txt (contract-msg c players (msg/pick rng msg-pool))
-                               face (mod (:who c) 4)]
-                           (conj msgs {:text txt :face face}))
+                  msgs (if outcome
+                         (conj msgs {:event :contract :outcome outcome
+                                     :who (:who c) :what (:what c)
+                                     :amount (:amount c)
+                                     :draw (r/uniform rng 0.0 1.0)
+                                     :face (mod (:who c) 4)})
                          msgs)]
               (recur pend (inc idx) state (conj new-pend contract) msgs))))))))
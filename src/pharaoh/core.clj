@@ -2,9 +2,13 @@
   (:require [quil.core :as q]
             [quil.applet :as applet]
             [quil.middleware :as m]
+            [pharaoh.autosave :as as]
+            [pharaoh.commodities :as cm]
+            [pharaoh.engine :as eng]
             [pharaoh.state :as st]
             [pharaoh.random :as r]
-            [pharaoh.simulation :as sim]
+            [pharaoh.scheduler :as sch]
+            [pharaoh.shm :as shm]
             [pharaoh.neighbors :as nb]
             [pharaoh.visits :as vis]
             [pharaoh.speech :as speech]
@@ -14,14 +18,60 @@
             [pharaoh.ui.input :as inp]
             [pharaoh.ui.menu :as menu]
             [pharaoh.ui.file-actions :as fa]
-            [pharaoh.ui.dialogs :as dlg])
+            [pharaoh.ui.dialogs :as dlg]
+            [pharaoh.valuation :as va])
   (:import [javax.swing SwingUtilities WindowConstants]
-           [java.awt.event WindowAdapter])
+           [java.awt.event WindowAdapter]
+           [java.util.concurrent Executors ScheduledFuture ThreadFactory TimeUnit])
   (:gen-class))
 
 (def ^:private close-requested (atom false))
 (declare ^:private handle-close-request)
 
+;; The sketch does not loop. After each frame it sleeps until the next
+;; job in the timer wheel is due; input and the waker request a redraw.
+(def ^:private frame-ms 33)
+(def ^:private sketch (atom nil))
+(def ^:private pending-wake (atom nil))
+
+;; Offer valuations are worked out on an agent and drawn when ready.
+(def ^:private valuer (agent (va/empty-cache 1)))
+(def ^:private valued-offers (atom nil))
+
+;; A run asked for by input, as [engine job]. fun-mode applies input
+;; inside a swap! that may be retried, so the run only reaches the
+;; engine once the swap! is done (see submit-after-input).
+(def ^:private pending-run (atom nil))
+
+(defonce ^:private waker
+  (Executors/newSingleThreadScheduledExecutor
+    (reify ThreadFactory
+      (newThread [_ r] (doto (Thread. ^Runnable r "pharaoh-waker") (.setDaemon true))))))
+
+(defn- wake! []
+  (when-let [^processing.core.PApplet a @sketch]
+    (.redraw a)))
+
+(defn- sleep-until! [at now]
+  (when-let [^ScheduledFuture f @pending-wake]
+    (.cancel f false))
+  (reset! pending-wake
+          (when at
+            (.schedule waker ^Runnable wake! (long (max frame-ms (- at now)))
+                       TimeUnit/MILLISECONDS))))
+
+;; Jobs wait while the engine thread owns the game state. Visits also
+;; wait behind dialogs; autosave keeps its slot while a dialog is open.
+(def ^:private jobs
+  {:visits {:run vis/check-visits
+            :next (fn [app now]
+                    (when-not (eng/busy? (:engine app))
+                      (vis/next-visit app now)))}
+   :autosave {:run as/run
+              :next (fn [app now]
+                      (when-not (eng/busy? (:engine app))
+                        (as/next-save app now)))}})
+
 (defn- load-faces []
   (mapv #(q/load-image (str "resources/faces/man" (inc %) ".png"))
         (range 4)))
@@ -37,7 +87,10 @@
    :event     (q/load-image "resources/images/icon_event.png")})
 
 (defn- init-timers [rng]
-  (vis/init-timers rng (System/currentTimeMillis)))
+  (let [now (System/currentTimeMillis)]
+    (merge (vis/init-timers rng now)
+           (as/init-timer now)
+           {:timers (sch/make-wheel 250 256 now)})))
 
 (defn- install-close-handler []
   (let [canvas (.getNative (.getSurface (applet/current-applet)))
@@ -47,12 +100,21 @@
       (.removeWindowListener frame l))
     (.addWindowListener frame
       (proxy [WindowAdapter] []
-        (windowClosing [_] (reset! close-requested true))))))
+        (windowClosing [_] (reset! close-requested true) (wake!))))))
+
+;; -Dpharaoh.shm=PATH publishes live state there for external viewers.
+(defn- state-monitor []
+  (when-let [path (System/getProperty "pharaoh.shm")]
+    (let [w (shm/writer path)]
+      (fn [state phase-ns] (shm/publish! w state phase-ns)))))
 
 (defn- setup []
   (q/frame-rate 30)
+  (q/no-loop)
+  (reset! sketch (applet/current-applet))
   (q/text-font (q/create-font "Monospaced" lay/value-size))
   (install-close-handler)
+  (add-watch valuer ::redraw (fn [& _] (wake!)))
   (let [rng (r/make-rng (System/currentTimeMillis))
         men (nb/set-men rng)]
     (merge
@@ -62,7 +124,9 @@
        :menu {:open? false}
        :logo (q/load-image "resources/images/logo.png")
        :faces (load-faces)
-       :icons (load-icons)}
+       :icons (load-icons)
+       :engine (eng/start wake! (state-monitor))
+       :engine-seq 0}
       (init-timers rng))))
 
 (defn- dialog-shortcut [d]
@@ -251,16 +315,26 @@
         verb (if (= :buy (:type offer)) "BUY" "SELL")]
     (format "%s: %s %.0f %s @ %.0f gold %dmo"
             name verb (:amount offer)
-            (clojure.core/name (:what offer))
+            (cm/text (:what offer))
             (:price offer) (:duration offer))))
 
+(defn- fmt-value [offer]
+  (if-let [{:keys [ev default-risk]} (va/value @valuer offer)]
+    (format "EV %+.0f  risk %.0f%%" ev (* 100 default-risk))
+    "valuing..."))
+
+(defn- fmt-outlook [offer]
+  (when-let [{:keys [ev default-risk p10 p50 p90]} (va/value @valuer offer)]
+    (format " Expected value %+.0f gold, default risk %.0f%%; %s price at maturity %.0f / %.0f / %.0f (10th / 50th / 90th percentile)."
+            ev (* 100 default-risk) (cm/text (:what offer)) p10 p50 p90)))
+
 (defn- fmt-confirm [offer players]
   (let [name (get-in players [(:who offer) :name] "?")
         verb (if (= :buy (:type offer)) "sell" "buy")
         dir (if (= :buy (:type offer)) "to" "from")]
     (format "Will you %s %.0f %s %s %s for %.0f gold in %d months?"
             verb (:amount offer)
-            (clojure.core/name (:what offer))
+            (cm/text (:what offer))
             dir name (:price offer) (:duration offer))))
 
 (defn- draw-offer-list [d x y w players]
@@ -282,11 +356,15 @@
           (q/stroke 100))
         (q/fill 0)
         (q/text-size lay/label-size)
-        (q/text text (+ x 8) (+ oy lay/label-size))))))
+        (q/text text (+ x 8) (+ oy lay/label-size))
+        (q/fill 60 60 140)
+        (q/text-align :right :baseline)
+        (q/text (fmt-value (nth offers i)) (+ x w -8) (+ oy lay/label-size))
+        (q/text-align :left :baseline)))))
 
 (defn- draw-confirm-prompt [d x y w h players]
   (let [offer (nth (:active-offers d) (:selected d))
-        text (fmt-confirm offer players)]
+        text (str (fmt-confirm offer players) (fmt-outlook offer))]
     (q/fill 0)
     (q/text-size lay/value-size)
     (q/text-leading (* lay/value-size 1.3))
@@ -355,16 +433,54 @@
     (q/text-size lay/small-size)
     (q/text "[press any key]" text-x (+ y h -16))))
 
+;; Take the newest snapshot the engine has published, if not yet shown.
+(defn- adopt-snapshot [{:keys [engine engine-seq] :as app}]
+  (let [{:keys [seq state]} (eng/latest engine)]
+    (if (> seq engine-seq)
+      (assoc app :state state :engine-seq seq)
+      app)))
+
+(defn- submit-run [app kind]
+  (reset! pending-run [(:engine app) {:kind kind :rng (:rng app) :state (:state app)
+                                      :opts inp/year-run}])
+  app)
+
+(defn- submit-pending! []
+  (when-let [[engine job] (first (reset-vals! pending-run nil))]
+    (eng/submit! engine job)))
+
+;; Middleware, applied after fun-mode: submits a run once the input
+;; handler's swap! has settled.
+(defn- submit-after-input [options]
+  (reduce (fn [opts k]
+            (if-let [f (get opts k)]
+              (assoc opts k (fn [& args]
+                              (let [result (apply f args)]
+                                (submit-pending!)
+                                result)))
+              opts))
+          options [:key-pressed :mouse-pressed]))
+
+(defn- revalue-offers! [state]
+  (let [offers (:cont-offers state)]
+    (when-not (identical? offers @valued-offers)
+      (reset! valued-offers offers)
+      (send valuer va/revalue state))))
+
 (defn- update-app [app]
-  (let [app (if @close-requested (handle-close-request app) app)]
+  (let [app (if @close-requested (handle-close-request app) app)
+        app (adopt-snapshot app)
+        now (System/currentTimeMillis)]
     (if (= :game (:screen app))
       (let [old-msg (get-in app [:state :message])
-            app (vis/check-visits app (System/currentTimeMillis))
+            app (sch/run-due app jobs now)
             new-msg (get-in app [:state :message])]
         (when (and new-msg (not= old-msg new-msg))
           (speech/speak (:text new-msg) (:face new-msg)))
+        (revalue-offers! (:state app))
+        (sleep-until! (sch/next-due (:timers app)) now)
         app)
-      app)))
+      (do (sleep-until! nil now) app))))
 
 (def ^:private btn-labels
   ["[1] Easy  — small pyramid, generous credit"
@@ -419,11 +535,16 @@
   (and (map? (:message state))
        (nil? (:dialog state))))
 
+(defn- grid-covered? [app state]
+  (boolean (or (:dialog state) (:message state)
+               (get-in app [:menu :open?]))))
+
 (defn- draw [{:keys [screen state faces icons logo] :as app}]
   (if (= :difficulty screen)
-    (draw-difficulty logo)
+    (do (draw-difficulty logo)
+        (scr/invalidate!))
     (do
-      (scr/draw-screen state)
+      (scr/draw-screen state (grid-covered? app state))
       (draw-dialog state icons)
       (draw-contracts-dialog state)
       (when (show-face-message? state)
@@ -476,10 +597,19 @@
     (if (= (int raw-key) 27)
       (do (quit!) app)
       (su/select-difficulty app (su/difficulty-for-key raw-key)))
-    (if-let [result (menu/handle-menu-key app raw-key)]
-      result
-      (let [new-state (inp/handle-key (:rng app) (:state app) raw-key key)]
-        (apply-state-result app new-state)))))
+    ;; A run may have ended since the last frame; input acts on its result.
+    (let [app (adopt-snapshot app)]
+      (cond
+        (eng/busy? (:engine app))
+        (do (eng/cancel! (:engine app)) app)
+
+        :else
+        (if-let [result (menu/handle-menu-key app raw-key)]
+          result
+          (if-let [kind (inp/run-request (:state app) raw-key)]
+            (submit-run app kind)
+            (let [new-state (inp/handle-key (:rng app) (:state app) raw-key key)]
+              (apply-state-result app new-state))))))))
 
 (defn- mouse-moved [{:keys [screen state] :as app} {:keys [x y]}]
   (if (= :difficulty screen)
@@ -489,43 +619,54 @@
                 app)]
       (assoc app :state (inp/handle-mouse-move state x y)))))
 
-(defn- mouse-clicked [{:keys [screen state rng] :as app} {:keys [x y]}]
+(defn- mouse-clicked [{:keys [screen] :as app} {:keys [x y]}]
   (if (= :difficulty screen)
     (su/select-difficulty app (su/difficulty-for-click x y))
-    (cond
-      ;; Menu bar click
-      (and (<= y menu/menu-bar-h) (<= x 60))
-      (menu/toggle-menu app)
-
-      ;; Submenu click (save file list)
-      (and (get-in app [:menu :submenu :open?])
-           (let [items (get-in app [:menu :submenu :items])]
-             (menu/submenu-item-hit items x y)))
-      (let [items (get-in app [:menu :submenu :items])
-            hit (menu/submenu-item-hit items x y)
-            new-state (if (= :browse hit)
-                        (fa/do-open state)
-                        (fa/do-load-file state hit))]
-        (apply-state-result (menu/close-menu app) new-state))
-
-      ;; Menu dropdown item click
-      (get-in app [:menu :open?])
-      (if-let [action (menu/menu-item-hit x y)]
-        (let [new-state (case action
-                          :save (fa/do-save state)
-                          :save-as (fa/do-save-as state)
-                          :open (fa/do-open state)
-                          :new-game (fa/do-new-game state)
-                          :quit (fa/do-quit state))]
+    (let [{:keys [state rng] :as app} (adopt-snapshot app)]
+      (cond
+        ;; Any click stops a run in progress
+        (eng/busy? (:engine app))
+        (do (eng/cancel! (:engine app)) app)
+
+        ;; Menu bar click
+        (and (<= y menu/menu-bar-h) (<= x 60))
+        (menu/toggle-menu app)
+
+        ;; Submenu click (save file list)
+        (and (get-in app [:menu :submenu :open?])
+             (let [items (get-in app [:menu :submenu :items])]
+               (menu/submenu-item-hit items x y)))
+        (let [items (get-in app [:menu :submenu :items])
+              hit (menu/submenu-item-hit items x y)
+              new-state (if (= :browse hit)
+                          (fa/do-open state)
+                          (fa/do-load-file state hit))]
           (apply-state-result (menu/close-menu app) new-state))
-        (menu/close-menu app))
 
-      ;; Normal game click
-      :else
-      (let [new-state (inp/handle-mouse state x y rng)]
-        (if (:run-clicked new-state)
-          (assoc app :state (sim/do-run rng (dissoc new-state :run-clicked)))
-          (apply-state-result app new-state))))))
+        ;; Menu dropdown item click
+        (get-in app [:menu :open?])
+        (if-let [action (menu/menu-item-hit x y)]
+          (let [new-state (case action
+                            :save (fa/do-save state)
+                            :save-as (fa/do-save-as state)
+                            :open (fa/do-open state)
+                            :new-game (fa/do-new-game state)
+                            :quit (fa/do-quit state))]
+            (apply-state-result (menu/close-menu app) new-state))
+          (menu/close-menu app))
+
+        ;; Normal game click
+        :else
+        (let [new-state (inp/handle-mouse state x y rng)]
+          (if (:run-clicked new-state)
+            (submit-run (assoc app :state (dissoc new-state :run-clicked)) :run)
+            (apply-state-result app new-state)))))))
+
+(defn- redrawing [handler]
+  (fn [app event]
+    (let [app (handler app event)]
+      (q/redraw)
+      app)))
 
 (defn -main [& _args]
   (q/defsketch pharaoh-game
@@ -534,8 +675,8 @@
     :setup setup
     :update update-app
     :draw draw
-    :key-pressed key-pressed
-    :mouse-pressed mouse-clicked
-    :mouse-moved mouse-moved
+    :key-pressed (redrawing key-pressed)
+    :mouse-pressed (redrawing mouse-clicked)
+    :mouse-moved (redrawing mouse-moved)
     :on-close (fn [_] nil)
-    :middleware [m/fun-mode]))
+    :middleware [submit-after-input m/fun-mode]))
@@ -0,0 +1,43 @@
+(ns pharaoh.derived
+  (:require [pharaoh.economy :as ec]
+            [pharaoh.state :as st]))
+
+;; Display-only converters. RunMonth used to compute these every month;
+;; nothing in the next state depends on them, so they are computed when
+;; a view asks and memoized until one of their inputs changes.
+
+(def ^:private asset-inputs
+  [:slaves :oxen :horses :manure :wheat :gold :loan
+   :ln-fallow :ln-sewn :ln-grown :ln-ripe :prices])
+
+(defn- debt-asset [state]
+  (let [nw (ec/net-worth state)]
+    (if (and (pos? nw) (pos? (:loan state)))
+      (/ (:loan state) nw)
+      0)))
+
+(def converters
+  {:net-worth  {:inputs asset-inputs
+                :f (fn [s] (- (ec/net-worth s) (:loan s)))}
+   :debt-asset {:inputs asset-inputs :f debt-asset}
+   :total-land {:inputs [:ln-fallow :ln-sewn :ln-grown :ln-ripe]
+                :f st/total-land}})
+
+;; One entry per converter: the last state seen and the inputs it had.
+(def ^:private memo (atom {}))
+
+(defn- lookup [k state]
+  (let [{:keys [inputs f]} (converters k)
+        {seen :state old-key :key v :value} (get @memo k)]
+    (if (identical? seen state)
+      v
+      (let [new-key (mapv #(get state %) inputs)
+            v (if (and seen (= old-key new-key)) v (f state))]
+        (swap! memo assoc k {:state state :key new-key :value v})
+        v))))
+
+(defn value [state k]
+  (lookup k state))
+
+(defn values [state ks]
+  (into {} (map (fn [k] [k (lookup k state)]) ks)))
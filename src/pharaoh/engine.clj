@@ -0,0 +1,79 @@
+(ns pharaoh.engine
+  (:require [pharaoh.autorun :as ar]
+            [pharaoh.simulation :as sim])
+  (:import [java.util.concurrent LinkedBlockingQueue]
+           [java.util.concurrent.atomic AtomicBoolean AtomicReference]))
+
+;; The simulation runs on its own thread. The UI hands it a state and a
+;; job; the worker publishes each month's state as a snapshot, and the UI
+;; only ever reads the latest one. Game states are persistent maps, so a
+;; published snapshot is never written again: one AtomicReference written
+;; by the worker alone is the whole handoff, with no buffers to rotate.
+;;
+;; A job is {:kind :run|:autorun :rng rng :state state :opts autorun-opts}.
+;;
+;; An optional monitor, (fn [state phase-ns]), sees every published state
+;; on the worker thread with the last month's phase timings.
+
+(defn latest [engine]
+  (.get ^AtomicReference (:latest engine)))
+
+(defn busy? [engine]
+  (.get ^AtomicBoolean (:busy engine)))
+
+(defn cancel! [engine]
+  (.set ^AtomicBoolean (:cancel engine) true))
+
+(defn submit! [engine job]
+  (.set ^AtomicBoolean (:cancel engine) false)
+  (.set ^AtomicBoolean (:busy engine) true)
+  (.put ^LinkedBlockingQueue (:jobs engine) job))
+
+(defn- publish! [engine state]
+  (let [^AtomicReference ref (:latest engine)]
+    (.set ref {:seq (inc (:seq (.get ref))) :state state})
+    (when-let [monitor (:monitor engine)]
+      (monitor state (:phase-ns engine)))
+    ((:on-publish engine))))
+
+(defn- run-job [engine {:keys [kind rng state opts]}]
+  (case kind
+    :run (sim/do-run rng state)
+    :autorun (loop [s (ar/start state opts)]
+               (let [s (if (.get ^AtomicBoolean (:cancel engine))
+                         (ar/cancel s)
+                         (ar/step rng s))]
+                 (if (:autorun s)
+                   (do (publish! engine s) (recur s))
+                   s)))))
+
+;; The last snapshot of a job is published before busy is cleared, so a
+;; reader that sees busy? false also sees the job's final state.
+(defn- work [engine]
+  (binding [sim/*phase-ns* (:phase-ns engine)]
+    (loop []
+      (let [job (.take ^LinkedBlockingQueue (:jobs engine))
+            result (try
+                     (run-job engine job)
+                     (catch Exception e
+                       (.printStackTrace e)
+                       (:state job)))]
+        (publish! engine result)
+        (.set ^AtomicBoolean (:busy engine) false)
+        ((:on-publish engine))
+        (recur)))))
+
+(defn start
+  ([on-publish] (start on-publish nil))
+  ([on-publish monitor]
+   (let [engine {:jobs (LinkedBlockingQueue.)
+                 :latest (AtomicReference. {:seq 0 :state nil})
+                 :busy (AtomicBoolean. false)
+                 :cancel (AtomicBoolean. false)
+                 :on-publish on-publish
+                 :monitor monitor
+                 :phase-ns (when monitor (long-array (count sim/phase-names)))}]
+     (doto (Thread. ^Runnable #(work engine) "pharaoh-engine")
+       (.setDaemon true)
+       (.start))
+     engine)))
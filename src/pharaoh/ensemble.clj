@@ -0,0 +1,253 @@
+(ns pharaoh.ensemble
+  (:require [clojure.edn :as edn]
+            [clojure.java.io :as io]
+            [clojure.string :as str]
+            [pharaoh.economy :as ec]
+            [pharaoh.random :as r]
+            [pharaoh.shm :as shm]
+            [pharaoh.telemetry :as tm]
+            [pharaoh.timelapse :as tl]
+            [pharaoh.transactions :as tx]
+            [pharaoh.world :as world])
+  (:import [java.nio.file Files StandardCopyOption]
+           [java.util Base64]
+           [java.util.concurrent Callable ConcurrentHashMap ExecutorService Executors
+            Future ScheduledExecutorService TimeUnit]
+           [java.util.concurrent.atomic AtomicBoolean]
+           [java.util.concurrent.locks ReentrantReadWriteLock])
+  (:gen-class))
+
+;; Many independent games, each played by a policy for a number of
+;; months, spread over a thread pool. A run is keyed by policy, seed and
+;; level; its run id is its place in (runs spec), so ids, summaries and
+;; telemetry rows line up whatever the thread count. Each run keeps its
+;; own rng and gives the same result wherever it is scheduled. A summary
+;; also keeps the lowest and highest value each tracked variable reached.
+;;
+;; With :checkpoint, a sweep can be stopped and resumed. Every game
+;; publishes its state, rng and extremes after each month under a read
+;; lock; the checkpointer takes the write lock, so it waits only for the
+;; months in progress, copies the finished summaries and the in-flight
+;; games (the states are values; only the rngs need snapshotting), and
+;; writes the file after letting go. A resumed sweep reloads both and
+;; ends with the same summaries as one that never stopped. A resumed
+;; sweep appends to its telemetry file rather than starting it again;
+;; the months played after the last checkpoint are recorded a second
+;; time, so a reader keeps the last row for each run and month.
+
+(def policies
+  {"default" world/default-policy
+   "idle" (constantly [])})
+
+(def default-track ["slHealth" "oxHealth" "hsHealth" "gold" "loan" "pyHeight"])
+
+(def ^:private var-paths (into {} shm/vars))
+
+(defn runs [{:keys [policies levels seeds]}]
+  (vec (for [p policies l levels s seeds]
+         {:policy p :level l :seed s})))
+
+(defn- over? [state]
+  (or (:game-over state) (:game-won state)))
+
+(defn- month-index [state]
+  (+ (* 12 (:year state)) (:month state)))
+
+(defn- extremes [track state lo hi]
+  (reduce (fn [[lo hi] k]
+            (let [v (get-in state (var-paths k))]
+              (if (number? v)
+                [(assoc lo k (min (get lo k v) v)) (assoc hi k (max (get hi k v) v))]
+                [lo hi])))
+          [lo hi] track))
+
+(defn- summarize [run-id run state months [lo hi]]
+  (assoc run
+         :run run-id
+         :months months
+         :outcome (cond (:game-over state) :bankrupt
+                        (:game-won state) :won
+                        :else :survived)
+         :bankrupt-month (when (:game-over state) (month-index state))
+         :bankrupt-year (when (:game-over state) (:year state))
+         :min lo
+         :max hi
+         :gold (:gold state)
+         :py-height (:py-height state)
+         :net-worth (- (ec/net-worth state) (:loan state))))
+
+(defn- new-game [{:keys [level seed]}]
+  (let [rng (r/make-rng seed)]
+    {:rng rng :state (tl/new-game rng level) :m 0 :seen [{} {}]}))
+
+(defn- with-read-lock [^ReentrantReadWriteLock lock f]
+  (if lock
+    (let [l (.readLock lock)]
+      (.lock l)
+      (try (f) (finally (.unlock l))))
+    (f)))
+
+;; on-month, if given, sees every month as (on-month run-id state).
+;; track names the shm/vars whose extremes are kept. A game resumes
+;; from {:rng :state :m :seen} when given one; it gives up (returning
+;; nil) at a month boundary once cancel is set.
+(defn run-game
+  ([spec run-id run] (run-game spec run-id run nil))
+  ([{:keys [months on-month track lock ^ConcurrentHashMap live
+            ^ConcurrentHashMap done ^AtomicBoolean cancel]
+     :or {track default-track}}
+    run-id {:keys [policy] :as run} resume]
+   (let [{:keys [rng state m seen]} (or resume (new-game run))
+         act (get policies policy policy)]
+     (loop [state state m m seen seen]
+       (cond
+         (or (>= m months) (over? state))
+         (let [summary (summarize run-id run state m seen)]
+           (when live
+             (with-read-lock lock (fn []
+                                    (.remove live run-id)
+                                    (.put done run-id summary))))
+           summary)
+
+         (and cancel (.get cancel)) nil
+
+         :else
+         (let [[state seen]
+               (with-read-lock lock
+                 (fn []
+                   (let [state (tl/batch-month rng (:state (tx/apply-orders rng state (act state))))
+                         seen (extremes track state (seen 0) (seen 1))]
+                     (when live (.put live run-id [state rng (inc m) seen]))
+                     [state seen])))]
+           (when on-month (on-month run-id state))
+           (recur state (inc m) seen)))))))
+
+;; What a checkpoint must match to be resumed.
+(defn- sweep-key [{:keys [months track] :or {track default-track} :as spec}]
+  (hash {:runs (runs spec) :months months :track track}))
+
+(defn- encode-rng [rng] (.encodeToString (Base64/getEncoder) (r/snapshot rng)))
+(defn- decode-rng [^String s] (r/restore (.decode (Base64/getDecoder) s)))
+
+(defn- checkpoint! [{:keys [path]} sweep ^ReentrantReadWriteLock lock
+                    ^ConcurrentHashMap live ^ConcurrentHashMap done]
+  (let [l (.writeLock lock)
+        [inflight finished] (do (.lock l)
+                                (try
+                                  [(into {} (for [[id [state rng m seen]] live]
+                                              [id {:state state :rng (encode-rng rng)
+                                                   :m m :seen seen}]))
+                                   (into {} done)]
+                                  (finally (.unlock l))))
+        tmp (io/file (str path ".tmp"))]
+    (spit tmp (pr-str {:sweep sweep :done finished :inflight inflight}))
+    (Files/move (.toPath tmp) (.toPath (io/file path))
+                (into-array StandardCopyOption [StandardCopyOption/REPLACE_EXISTING
+                                                StandardCopyOption/ATOMIC_MOVE]))))
+
+(defn- load-checkpoint [{:keys [path]} sweep]
+  (when (.exists (io/file path))
+    (let [saved (edn/read-string (slurp path))]
+      (when-not (= sweep (:sweep saved))
+        (throw (ex-info "Checkpoint is for a different sweep" {:path path})))
+      (update saved :inflight
+              (fn [m] (into {} (map (fn [[id g]] [id (update g :rng decode-rng)])) m))))))
+
+;; spec: :policies (names in the policies map, or fns) :levels :seeds
+;; :months :threads :track, :telemetry, a pharaoh.telemetry writer that
+;; gets every game-month, :checkpoint {:path :every-ms}, and :cancel, an
+;; AtomicBoolean that stops the sweep at the next month boundary, and
+;; :only [from to] to play just those run ids. Returns the summaries in
+;; run order, or nil if cancelled.
+(defn run [{:keys [threads telemetry checkpoint ^AtomicBoolean cancel only]
+            :or {threads (.availableProcessors (Runtime/getRuntime))}
+            :as spec}]
+  (let [sweep (when checkpoint (sweep-key spec))
+        saved (when checkpoint (load-checkpoint checkpoint sweep))
+        live (ConcurrentHashMap.)
+        done (ConcurrentHashMap. ^java.util.Map (or (:done saved) {}))
+        lock (when checkpoint (ReentrantReadWriteLock.))
+        spec (cond-> spec
+               telemetry (assoc :on-month #(tm/record! telemetry %1 %2))
+               checkpoint (assoc :lock lock :live live :done done))
+        pool (Executors/newFixedThreadPool (int threads))
+        ^ScheduledExecutorService ticker
+        (when checkpoint
+          (doto (Executors/newSingleThreadScheduledExecutor)
+            (.scheduleWithFixedDelay #(checkpoint! checkpoint sweep lock live done)
+                                     (long (:every-ms checkpoint 300000))
+                                     (long (:every-ms checkpoint 300000))
+                                     TimeUnit/MILLISECONDS)))]
+    (try
+      (let [all (runs spec)
+            [from to] (or only [0 (count all)])
+            play (fn [i]
+                   (or (.get done i)
+                       (when-not (and cancel (.get cancel))
+                         (run-game spec i (all i) (get-in saved [:inflight i])))))
+            results (->> (range from to)
+                         (mapv (fn [i] ^Callable (fn [] (play i))))
+                         (.invokeAll pool)
+                         (mapv #(.get ^Future %)))]
+        (when ticker
+          (.shutdown ticker)
+          (.awaitTermination ticker 1 TimeUnit/MINUTES)
+          (checkpoint! checkpoint sweep lock live done))
+        (when-not (some nil? results) results))
+      (finally
+        (.shutdown ^ExecutorService pool)
+        (when ticker (.shutdownNow ticker))))))
+
+(defn- parse-args [args]
+  (into {} (map (fn [[k v]] [(keyword (str/replace k #"^--" "")) v])
+                (partition 2 args))))
+
+(defn- columns [names]
+  (if names
+    (let [wanted (set (str/split names #","))]
+      (filterv #(wanted (first %)) shm/vars))
+    shm/vars))
+
+;; clojure -M:ensemble [--seeds N] [--months N] [--levels Easy,Normal]
+;;                     [--policies default,idle] [--threads N]
+;;                     [--out FILE [--vars gold,slHealth]]
+;;                     [--checkpoint FILE [--checkpoint-every SECONDS]]
+;; With --checkpoint, an interrupted sweep checkpoints on the way out
+;; and the same command picks it up again.
+(defn -main [& args]
+  (let [{:keys [seeds months levels policies threads out vars checkpoint]
+         every :checkpoint-every} (parse-args args)
+        threads (if threads
+                  (Long/parseLong threads)
+                  (.availableProcessors (Runtime/getRuntime)))
+        writer (when out
+                 (tm/open-writer out (columns vars)
+                                 {:max-buffers (+ 2 (* 2 threads))
+                                  :append (boolean (and checkpoint (.exists (io/file checkpoint))))}))
+        spec {:policies (str/split (or policies "default") #",")
+              :levels (str/split (or levels "Normal") #",")
+              :seeds (range (if seeds (Long/parseLong seeds) 100))
+              :months (if months (Long/parseLong months) 480)
+              :threads threads
+              :telemetry writer
+              :checkpoint (when checkpoint
+                            {:path checkpoint
+                             :every-ms (* 1000 (if every (Long/parseLong every) 300))})
+              :cancel (AtomicBoolean.)}
+        finished (promise)
+        _ (.addShutdownHook (Runtime/getRuntime)
+                            (Thread. ^Runnable #(do (.set ^AtomicBoolean (:cancel spec) true)
+                                                    @finished)))
+        t0 (System/nanoTime)
+        results (try (run spec)
+                     (finally (when writer (tm/close! writer))
+                              (deliver finished true)))
+        secs (/ (- (System/nanoTime) t0) 1e9)]
+    (if results
+      (do (doseq [[outcome n] (sort-by key (frequencies (map :outcome results)))]
+            (println (format "%-9s %d" (name outcome) n)))
+          (println (format "%d runs, %d game-months in %.2f s"
+                           (count results) (reduce + (map :months results)) secs)))
+      (println "Stopped after" (format "%.2f s" secs)
+               (if checkpoint (str "; resume from " checkpoint) "")))
+    (shutdown-agents)))
@@ -215,6 +215,16 @@
     :war           (war-message rng (or extra 1.0))
     nil))
 
+;; Pool picks each event message spends. The draws are taken when the
+;; event happens and the text is chosen from them only if it is shown.
+(def message-picks
+  {:acts-of-god 4 :acts-of-mobs 5 :plagues 2 :locusts 1
+   :health-events 1 :workload 1 :labor-event 1 :wheat-event 1
+   :gold-event 1 :economy-event 1 :revolt 1 :war 1})
+
+(defn message-draws [rng etype]
+  (vec (repeatedly (get message-picks etype 0) #(r/uniform rng 0.0 1.0))))
+
 (defn random-event [rng state]
   (let [roll (long (r/uniform rng 0.0 100.0))
         etype (event-type roll)
@@ -3,6 +3,7 @@
             [pharaoh.contracts :as ct]
             [pharaoh.gherkin.steps.helpers :refer [near? assert-near to-double ensure-rng snap]]
             [pharaoh.messages :as msg]
+            [pharaoh.notices :as nt]
             [pharaoh.random :as r]
             [pharaoh.simulation :as sim]
             [pharaoh.state :as st]
@@ -131,7 +132,8 @@
 
    {:type :then :pattern #"the message mentions the counterparty name and commodity"
     :handler (fn [w]
-               (let [msg (:text (first (:contract-msgs (:state w))))]
+               (let [s (:state w)
+                     msg (nt/text s (first (:contract-msgs s)))]
                  (assert (re-find #"Regarding your contract with" msg)
                          (str "Expected contract message format, got: " msg)))
                w)}
@@ -526,7 +528,7 @@
                          (assoc s :gold (max (:gold s 0) (:price contract))))
                      result (ct/fulfill-contract (:rng w) s contract (:players s))
                      new-s (:state result)
-                     pool (:msg-pool result)
+                     pool (ct/outcome-messages (:outcome result))
                      m (when pool (msg/pick (:rng w) pool))]
                  (assoc w :state (if m (assoc new-s :message m) new-s))))}
    {:type :when :pattern #"the player accepts the contract"
@@ -88,7 +88,6 @@
                          s (#'sim/apply-market s rng)
                          s (#'sim/apply-credit-update s)
                          s (#'sim/check-emergency-loan s)
-                         s (#'sim/update-net-worth s)
                          s (#'sim/check-foreclosure s rng)
                          s (#'sim/check-debt-warning s rng)
                          s (#'sim/check-win s)
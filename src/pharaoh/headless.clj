@@ -0,0 +1,103 @@
+(ns pharaoh.headless
+  (:require [clojure.string :as str]
+            [pharaoh.autorun :as ar]
+            [pharaoh.persistence :as ps]
+            [pharaoh.random :as r]
+            [pharaoh.shm :as shm]
+            [pharaoh.simulation :as sim]
+            [pharaoh.timelapse :as tl]
+            [pharaoh.ui.input :as inp])
+  (:gen-class))
+
+;; Runs the game with no window: keystrokes come from a script instead of
+;; Quil, and every message is written to a transcript and acknowledged
+;; on the player's behalf. Nothing here loads Quil, so it runs under the
+;; :headless alias on a server JVM for profiling and benchmarks.
+;;
+;; A script is plain text. Characters are typed as they stand; <enter>,
+;; <esc>, <bs>, <up> and <down> name special keys; whitespace separates
+;; keystrokes and is otherwise ignored; # starts a comment to end of line.
+
+(def ^:private coded (char 0xFFFF))
+
+(def ^:private named-keys
+  {"enter" [\return nil] "esc" [(char 27) nil] "bs" [\backspace nil]
+   "up" [coded :up] "down" [coded :down]})
+
+(defn parse-script [text]
+  (->> (str/split-lines text)
+       (map #(str/replace % #"#.*" ""))
+       (mapcat #(re-seq #"<[a-z]+>|\S" %))
+       (mapv (fn [tok]
+               (if (str/starts-with? tok "<")
+                 (or (named-keys (subs tok 1 (dec (count tok))))
+                     (throw (ex-info "Unknown key in script" {:key tok})))
+                 [(first tok) nil])))))
+
+(defn- message-text [msg]
+  (if (map? msg) (:text msg) msg))
+
+;; The stand-in for ModalDialog and the alert boxes: anything showing
+;; outside a dialog goes to the log and is dismissed with a keystroke.
+(defn- acknowledge [rng {:keys [state log] :as run}]
+  (if (and (:message state) (not (:dialog state)))
+    (recur rng {:state (inp/handle-key rng state \space)
+                :log (conj log (message-text (:message state)))})
+    run))
+
+(defn- settle [rng state]
+  (-> (if (:autorun state) (ar/run-frame rng state Long/MAX_VALUE) state)
+      (dissoc :reset-visit-timers :pending-action)))
+
+(defn press [rng run [ch kw]]
+  (let [{:keys [state log]} (acknowledge rng run)
+        result (inp/handle-key rng state ch kw)]
+    {:state (settle rng (or (:loaded-state result) result))
+     :log log}))
+
+(defn run-script
+  ([rng state keys] (run-script rng state keys nil))
+  ([rng state keys monitor]
+   (loop [run {:state state :log []} keys keys]
+     (if (or (empty? keys) (get-in run [:state :quit-clicked])
+             (get-in run [:state :game-over]))
+       (acknowledge rng run)
+       (let [run (press rng run (first keys))]
+         (when monitor (monitor (:state run)))
+         (recur run (rest keys)))))))
+
+(defn- parse-args [args]
+  (into {} (map (fn [[k v]] [(keyword (str/replace k #"^--" "")) v])
+                (partition 2 args))))
+
+;; clojure -M:headless [--seed N] [--difficulty Easy|Normal|Hard]
+;;                     [--load SAVED-GAME] [--script FILE] [--months N]
+;;                     [--shm PATH]
+;; --months appends N presses of r to the script. --shm publishes the
+;; state after every keystroke for pharaoh.shm viewers.
+(defn- shm-monitor [path ^longs phase-ns]
+  (when path
+    (let [w (shm/writer path)]
+      #(shm/publish! w % phase-ns))))
+
+(defn -main [& args]
+  (let [{:keys [seed difficulty load script months shm]} (parse-args args)
+        rng (r/make-rng (if seed (Long/parseLong seed) (System/currentTimeMillis)))
+        state (if load (ps/load-game load) (tl/new-game rng (or difficulty "Normal")))
+        keys (concat (when script (parse-script (slurp script)))
+                     (repeat (if months (Long/parseLong months) 0) [\r nil]))
+        phase-ns (long-array (count sim/phase-names))
+        monitor (shm-monitor shm phase-ns)
+        t0 (System/nanoTime)
+        {:keys [state log]} (binding [sim/*phase-ns* (when monitor phase-ns)]
+                              (run-script rng state keys monitor))
+        secs (/ (- (System/nanoTime) t0) 1e9)]
+    (doseq [line log] (println line))
+    (println (format "Year %d month %d  gold %.0f  loan %.0f  pyramid %.1f%s"
+                     (:year state) (:month state) (double (:gold state))
+                     (double (:loan state)) (double (:py-height state))
+                     (cond (:game-over state) "  (foreclosed)"
+                           (:game-won state) "  (won)"
+                           :else "")))
+    (println (format "%d keys in %.3f s" (count keys) secs))
+    (shutdown-agents)))
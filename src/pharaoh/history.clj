@@ -0,0 +1,184 @@
+(ns pharaoh.history
+  (:require [pharaoh.shm :as shm])
+  (:import [java.util Arrays]))
+
+;; Month-by-month history of every shm/vars column, for charts and
+;; trend advice, over a whole 40-year game. Each column is a run of
+;; sealed chunks of chunk-size months plus an open tail. A chunk is
+;; Gorilla-compressed: the first value in full, then each value XORed
+;; with the one before. Unchanged values cost one bit, and slowly moving
+;; ones only their changed middle bits. A chunk is sealed when its tail
+;; fills, so appending is O(1), and a range scan decodes only the chunks
+;; it touches. The history is a value, like the state it records.
+
+(def chunk-size 64)
+
+;; Worst case per value: 2 control bits, 6 for leading zeros, 6 for the
+;; length and 64 of payload.
+(def ^:private max-words (inc (quot (* chunk-size 78) 64)))
+
+(defn empty-history
+  ([] (empty-history shm/vars))
+  ([columns]
+   {:columns (mapv first columns)
+    :paths (mapv second columns)
+    :index (into {} (map-indexed (fn [i [k]] [k i])) columns)
+    :first-month nil
+    :months 0
+    :sealed (vec (repeat (count columns) []))
+    :tail (vec (repeat (count columns) []))}))
+
+(defn- put-bits ^long [^longs buf ^long pos ^long v ^long n]
+  (let [word (unsigned-bit-shift-right pos 6)
+        space (- 64 (bit-and pos 63))
+        v (if (== n 64) v (bit-and v (dec (bit-shift-left 1 n))))]
+    (if (<= n space)
+      (aset buf word (bit-or (aget buf word) (bit-shift-left v (- space n))))
+      (do (aset buf word (bit-or (aget buf word) (unsigned-bit-shift-right v (- n space))))
+          (aset buf (inc word) (bit-shift-left v (- 64 (- n space))))))
+    (+ pos n)))
+
+(defn- get-bits ^long [^longs buf ^long pos ^long n]
+  (let [word (unsigned-bit-shift-right pos 6)
+        space (- 64 (bit-and pos 63))
+        mask (if (== n 64) -1 (dec (bit-shift-left 1 n)))]
+    (if (<= n space)
+      (bit-and (unsigned-bit-shift-right (aget buf word) (- space n)) mask)
+      (let [rest-n (- n space)
+            hi (bit-and (aget buf word) (dec (bit-shift-left 1 space)))]
+        (bit-and (bit-or (bit-shift-left hi rest-n)
+                         (unsigned-bit-shift-right (aget buf (inc word)) (- 64 rest-n)))
+                 mask)))))
+
+(defn encode-chunk [values]
+  (let [buf (long-array max-words)
+        xs (mapv #(Double/doubleToRawLongBits (double %)) values)
+        pos (loop [i 1 pos (put-bits buf 0 (nth xs 0) 64) lead -1 trail -1]
+              (if (>= i (count xs))
+                pos
+                (let [x (bit-xor (long (nth xs i)) (long (nth xs (dec i))))]
+                  (if (zero? x)
+                    (recur (inc i) (put-bits buf pos 0 1) lead trail)
+                    (let [l (long (Long/numberOfLeadingZeros x))
+                          t (long (Long/numberOfTrailingZeros x))]
+                      (if (and (>= lead 0) (>= l lead) (>= t trail))
+                        (let [pos (put-bits buf pos 2 2)]
+                          (recur (inc i)
+                                 (put-bits buf pos (unsigned-bit-shift-right x trail)
+                                           (- 64 lead trail))
+                                 lead trail))
+                        (let [len (- 64 l t)
+                              pos (put-bits buf pos 3 2)
+                              pos (put-bits buf pos l 6)
+                              pos (put-bits buf pos (dec len) 6)]
+                          (recur (inc i)
+                                 (put-bits buf pos (unsigned-bit-shift-right x t) len)
+                                 l t))))))))]
+    {:n (count xs)
+     :bits (Arrays/copyOf buf (int (quot (+ pos 63) 64)))}))
+
+(defn decode-chunk ^doubles [{:keys [n bits]}]
+  (let [^longs bits bits
+        out (double-array n)
+        first-x (get-bits bits 0 64)]
+    (aset out 0 (Double/longBitsToDouble first-x))
+    (loop [i 1 pos 64 prev first-x lead 0 trail 0]
+      (when (< i n)
+        (if (zero? (get-bits bits pos 1))
+          (do (aset out i (Double/longBitsToDouble prev))
+              (recur (inc i) (inc pos) prev lead trail))
+          (let [reuse? (zero? (get-bits bits (inc pos) 1))
+                pos (+ pos 2)
+                [lead trail pos] (if reuse?
+                                   [lead trail pos]
+                                   (let [l (get-bits bits pos 6)
+                                         len (inc (get-bits bits (+ pos 6) 6))]
+                                     [l (- 64 l len) (+ pos 12)]))
+                len (- 64 lead trail)
+                x (bit-shift-left (get-bits bits pos len) trail)
+                v (bit-xor prev x)]
+            (aset out i (Double/longBitsToDouble v))
+            (recur (inc i) (+ pos len) v (long lead) (long trail))))))
+    out))
+
+(defn- sample [state path]
+  (let [v (get-in state path)]
+    (if (number? v) (double v) Double/NaN)))
+
+(defn- month-of [state]
+  (+ (* 12 (:year state)) (:month state)))
+
+(defn- push [h month values]
+  (let [tail (mapv conj (:tail h) values)
+        h (-> h
+              (assoc :tail tail)
+              (update :months inc)
+              (update :first-month #(or % month)))]
+    (if (< (count (first tail)) chunk-size)
+      h
+      (assoc h
+             :sealed (mapv #(conj %1 (encode-chunk %2)) (:sealed h) tail)
+             :tail (vec (repeat (count tail) []))))))
+
+(defn append [{:keys [paths] :as h} state]
+  (push h (month-of state) (mapv #(sample state %) paths)))
+
+(defn last-month [{:keys [first-month months]}]
+  (when first-month (+ first-month months -1)))
+
+;; Appends a state seen by an engine monitor. A repeat of the last month
+;; is ignored, and a month from before it (a new or loaded game) starts
+;; a fresh history. Months skipped over (a load further on) are NaN, so
+;; every sample stays at its month's index.
+(defn record [h state]
+  (let [m (month-of state)
+        last-m (last-month h)]
+    (cond
+      (nil? last-m) (append h state)
+      (> m last-m) (append (reduce (fn [h _] (push h nil (vec (repeat (count (:paths h)) Double/NaN))))
+                                   h (range (- m last-m 1)))
+                           state)
+      (= m last-m) h
+      :else (append (empty-history (map vector (:columns h) (:paths h))) state))))
+
+;; Values of a column for months [from, to), counted from the first
+;; recorded month.
+(defn column ^doubles [{:keys [index sealed tail months]} column-name from to]
+  (let [i (index column-name)
+        from (max 0 from)
+        to (min months to)
+        out (double-array (max 0 (- to from)))
+        chunks (nth sealed i)
+        open (nth tail i)]
+    (loop [c (quot from chunk-size)]
+      (let [start (* c chunk-size)]
+        (when (< start to)
+          (let [lo (max from start)
+                hi (min to (+ start chunk-size))]
+            (if (< c (count chunks))
+              (System/arraycopy (decode-chunk (nth chunks c)) (- lo start)
+                                out (- lo from) (- hi lo))
+              (doseq [k (range lo hi)]
+                (aset out (- k from) (double (nth open (- k start))))))
+            (recur (inc c))))))
+    out))
+
+(defn latest [{:keys [months] :as h} column-name]
+  (when (pos? months)
+    (aget (column h column-name (dec months) months) 0)))
+
+;; Least-squares slope per month over the last n months.
+(defn trend [{:keys [months] :as h} column-name n]
+  (let [ys (column h column-name (- months n) months)
+        k (alength ys)]
+    (when (> k 1)
+      (let [mx (/ (dec k) 2.0)
+            my (/ (areduce ys i s 0.0 (+ s (aget ys i))) k)
+            sxy (areduce ys i s 0.0 (+ s (* (- i mx) (- (aget ys i) my))))
+            sxx (areduce ys i s 0.0 (+ s (* (- i mx) (- i mx))))]
+        (/ sxy sxx)))))
+
+;; Approximate payload bytes: packed chunks plus the open tail.
+(defn byte-size [{:keys [sealed tail]}]
+  (+ (reduce + (for [chunks sealed c chunks] (* 8 (alength ^longs (:bits c)))))
+     (* 8 (reduce + (map count tail)))))
@@ -0,0 +1,157 @@
+(ns pharaoh.model
+  (:require [clojure.set :as set]))
+
+;; A model is the declarative form of a block of vars.h converters:
+;;   {:inputs    [:sl-health ...]   state keys read by the equations
+;;    :outputs   [:max-wk-sl ...]   default result keys
+;;    :equations [{:id :sl-dth-k :expr (t/interpolate sl-health t/slave-death)
+;;                 :noise 0.1} ...]}
+;; :expr is a quoted form. Inputs and other equations are referred to by
+;; the bare symbol of their key. :noise multiplies the value by
+;; abs-gaussian(1, noise), the C idiom for table lookups.
+;;
+;; defkernel compiles a model to a scalar kernel; deftangent compiles the
+;; forward-mode derivative of the same outputs with respect to one input.
+
+(defn- refs [expr]
+  (->> (tree-seq coll? seq expr)
+       (filter symbol?)
+       (remove namespace)
+       (map keyword)
+       set))
+
+(defn equation-deps [{:keys [equations]}]
+  (let [ids (set (map :id equations))]
+    (into {} (map (fn [{:keys [id expr]}]
+                    [id (set (filter ids (refs expr)))])
+                  equations))))
+
+;; Noise equations draw from the rng, so they keep their declared order
+;; relative to each other: each one implicitly follows the previous one.
+(defn- ordering-deps [{:keys [equations] :as model}]
+  (let [deps (equation-deps model)
+        noisy (map :id (filter :noise equations))]
+    (reduce (fn [d [prev id]] (update d id conj prev))
+            deps (map vector noisy (rest noisy)))))
+
+(defn dependency-order [{:keys [equations] :as model}]
+  (let [deps (ordering-deps model)]
+    (loop [done #{} order [] remaining equations]
+      (if (empty? remaining)
+        order
+        (let [ready (first (filter #(every? done (deps (:id %))) remaining))]
+          (when-not ready
+            (throw (ex-info "Model has a dependency cycle"
+                            {:vars (mapv :id remaining)})))
+          (recur (conj done (:id ready))
+                 (conj order ready)
+                 (remove #(= (:id %) (:id ready)) remaining)))))))
+
+(defn live-vars [model outputs]
+  (let [deps (equation-deps model)]
+    (loop [live #{} frontier (set outputs)]
+      (if (empty? frontier)
+        live
+        (let [live (into live frontier)]
+          (recur live (set (remove live (mapcat deps frontier)))))))))
+
+(defn- local [k] (symbol (name k)))
+
+(defn- draw [noise]
+  `(pharaoh.random/abs-gaussian ~'rng 1.0 ~noise))
+
+;; Dead equations are dropped, except that a dead noisy equation still
+;; emits its bare draw so the rng stream matches the full model.
+(defn- bindings [steps live]
+  (mapcat (fn [{:keys [id expr noise]}]
+            (cond
+              (live id) [(local id) (if noise `(* ~expr ~(draw noise)) expr)]
+              noise ['_ (draw noise)]
+              :else []))
+          steps))
+
+(defn emit-kernel
+  ([model] (emit-kernel model nil))
+  ([{:keys [inputs outputs] :as model} wanted]
+   (let [wanted (vec (or wanted outputs))
+         live (live-vars model wanted)
+         steps (dependency-order model)
+         used (apply set/union
+                     (map (comp refs :expr) (filter (comp live :id) steps)))
+         inputs (filter used inputs)]
+     `(fn [~'rng ~'state]
+        (let [~@(mapcat (fn [k] [(local k) `(~k ~'state)]) inputs)
+              ~@(bindings steps live)]
+          ~(into {} (map (fn [k] [k (local k)]) wanted)))))))
+
+;; Expressions resolve in the namespace that invokes defkernel.
+(defmacro defkernel
+  ([name model] `(defkernel ~name ~model nil))
+  ([name model outputs]
+   (let [m @(resolve model)
+         outs (if (symbol? outputs) @(resolve outputs) outputs)]
+     `(def ~name ~(emit-kernel m outs)))))
+
+;; Forward-mode differentiation of one equation. Locals carry their
+;; tangent in d-<name>; table lookups differentiate through t/slope.
+(defn- d-local [k] (symbol (str "d-" (name k))))
+
+(defn- tangent [expr]
+  (cond
+    (number? expr) 0.0
+    (and (symbol? expr) (not (namespace expr))) (d-local (keyword expr))
+    (seq? expr)
+    (let [[head & args] expr]
+      (case (name head)
+        "+" `(+ ~@(map tangent args))
+        "-" `(- ~@(map tangent args))
+        "*" (second (reduce (fn [[a da] [b db]] [`(* ~a ~b) `(+ (* ~da ~b) (* ~a ~db))])
+                            (map (juxt identity tangent) args)))
+        "/" (let [[a b] args]
+              `(/ (- (* ~(tangent a) ~b) (* ~a ~(tangent b))) (* ~b ~b)))
+        "if" (let [[c a b] args] `(if ~c ~(tangent a) ~(tangent b)))
+        "max" (let [[a b] args] `(if (>= ~a ~b) ~(tangent a) ~(tangent b)))
+        "min" (let [[a b] args] `(if (<= ~a ~b) ~(tangent a) ~(tangent b)))
+        "interpolate" (let [[x table] args]
+                        `(* (~(symbol (namespace head) "slope") ~x ~table) ~(tangent x)))
+        (throw (ex-info "No derivative rule" {:expr expr}))))
+    :else (throw (ex-info "No derivative rule" {:expr expr}))))
+
+(defn- tangent-bindings [steps live]
+  (mapcat (fn [{:keys [id expr noise]}]
+            (let [g (symbol (str "g-" (name id)))]
+              (cond
+                (and (live id) noise)
+                [g (draw noise)
+                 (local id) `(* ~expr ~g)
+                 (d-local id) `(* ~(tangent expr) ~g)]
+                (live id) [(local id) expr (d-local id) (tangent expr)]
+                noise ['_ (draw noise)]
+                :else [])))
+          steps))
+
+;; Returns {:value {out v} :tangent {out dv/d-wrt}}. The rng is drawn
+;; exactly as by the scalar kernel, so the two see the same noise.
+(defn emit-tangent-kernel
+  ([model wrt] (emit-tangent-kernel model wrt nil))
+  ([{:keys [inputs outputs] :as model} wrt wanted]
+   (let [wanted (vec (or wanted outputs))
+         live (live-vars model wanted)
+         steps (dependency-order model)
+         used (apply set/union
+                     (map (comp refs :expr) (filter (comp live :id) steps)))
+         inputs (filter used inputs)]
+     `(fn [~'rng ~'state]
+        (let [~@(mapcat (fn [k] [(local k) `(~k ~'state)
+                                 (d-local k) (if (= k wrt) 1.0 0.0)])
+                        inputs)
+              ~@(tangent-bindings steps live)]
+          {:value ~(into {} (map (fn [k] [k (local k)]) wanted))
+           :tangent ~(into {} (map (fn [k] [k (d-local k)]) wanted))})))))
+
+(defmacro deftangent
+  ([name model wrt] `(deftangent ~name ~model ~wrt nil))
+  ([name model wrt outputs]
+   (let [m @(resolve model)
+         outs (if (symbol? outputs) @(resolve outputs) outputs)]
+     `(def ~name ~(emit-tangent-kernel m wrt outs)))))
@@ -0,0 +1,26 @@
+(ns pharaoh.notices
+  (:require [pharaoh.contracts :as ct]
+            [pharaoh.events :as ev]
+            [pharaoh.messages :as msg]
+            [pharaoh.random :as r]))
+
+;; A notice is what the simulation records when something is worth telling
+;; the player: the event type, its parameters, and the draws the C code
+;; spent picking the wording. The string is built here, only when a notice
+;; is about to be shown. Maps that already carry :text pass through.
+
+(defn text [state notice]
+  (case (:event notice)
+    :contract (ct/contract-msg notice (:players state)
+                               (msg/pick (r/replay [(:draw notice)])
+                                         (ct/outcome-messages (:outcome notice))))
+    :random   (or (ev/event-message (r/replay (:draws notice)) (:type notice) nil)
+                  "Something happened...")
+    (:text notice)))
+
+(defn render [state notice]
+  {:text (text state notice) :face (:face notice)})
+
+(defn pop-next [state]
+  (let [[notice & more] (:contract-msgs state)]
+    (assoc state :message (render state notice) :contract-msgs (vec more))))
@@ -0,0 +1,112 @@
+(ns pharaoh.orderbook
+  (:require [pharaoh.contracts :as ct]
+            [pharaoh.random :as r]))
+
+;; Contracts for scenarios with many traders, such as pharaoh.world. A
+;; single game keeps C's fixed tables (15 offers, 10 pending, 10
+;; players) in pharaoh.contracts; a book has no caps and is indexed so
+;; that no monthly pass walks every contract:
+;;   :contracts {id contract}
+;;   :by-who    {who #{id}}       :by-what {what #{id}}
+;;   :trading   {[who what] id}   AlreadyTrading in one lookup
+;;   :due       (sorted-map month #{id})
+;; Months are absolute (see month-index). Every contract sits in exactly
+;; one due bucket: an offer at the month it is withdrawn, a pending
+;; contract at the month it defaults or comes due, whichever is first.
+;; The default month is drawn when the contract is accepted, from the
+;; same monthly chance ContProg rolls, so step-month only opens the
+;; buckets that have come round.
+
+(defn empty-book []
+  {:next-id 0 :contracts {} :by-who {} :by-what {} :trading {}
+   :due (sorted-map)})
+
+(defn month-index [{:keys [year month]}]
+  (+ (* 12 year) month))
+
+(defn- add-to [m k id] (update m k (fnil conj #{}) id))
+
+(defn- remove-from [m k id]
+  (let [ids (disj (get m k #{}) id)]
+    (if (empty? ids) (dissoc m k) (assoc m k ids))))
+
+(defn- index [book {:keys [id who what at] :as c}]
+  (-> book
+      (assoc-in [:contracts id] c)
+      (update :by-who add-to who id)
+      (update :by-what add-to what id)
+      (assoc-in [:trading [who what]] id)
+      (update :due add-to at id)))
+
+(defn- unindex [book id]
+  (let [{:keys [who what at]} (get-in book [:contracts id])]
+    (-> book
+        (update :contracts dissoc id)
+        (update :by-who remove-from who id)
+        (update :by-what remove-from what id)
+        (update :trading dissoc [who what])
+        (update :due remove-from at id))))
+
+(defn trading? [book who what]
+  (contains? (:trading book) [who what]))
+
+(defn contract [book id]
+  (get-in book [:contracts id]))
+
+(defn contracts-of [book who]
+  (map #(contract book %) (get-in book [:by-who who])))
+
+(defn contracts-in [book what]
+  (map #(contract book %) (get-in book [:by-what what])))
+
+;; C: NewOffers drifts an offer's price each month and withdraws it when
+;; eight months are left. Here the drift rate is drawn once and applied
+;; by age, so an idle offer costs nothing until it is read.
+(defn add-offer [rng book {:keys [who what type duration] :as c} now]
+  (if (trading? book who what)
+    book
+    (let [drift (if (= :buy type)
+                  (r/uniform rng 1.01 1.1)
+                  (r/uniform rng 0.90 0.99))]
+      (-> (index book (assoc c :id (:next-id book) :status :offer
+                             :listed now :drift drift
+                             :at (+ now (max 1 (- duration 8)))))
+          (update :next-id inc)))))
+
+(defn offer-price [{:keys [price drift listed]} now]
+  (* price (Math/pow drift (- now listed))))
+
+(defn accept [rng book id now player]
+  (let [c (contract book id)]
+    (if (not= :offer (:status c))
+      book
+      (let [age (- now (:listed c))
+            due (+ now (- (:duration c) age))
+            k (ct/months-to-default rng (:default-k player))
+            defaults? (and k (<= (+ now k) due))]
+        (-> (unindex book id)
+            (index (-> c
+                       (dissoc :drift :listed)
+                       (assoc :status :pending :price (offer-price c now)
+                              :duration (- (:duration c) age)
+                              :due due
+                              :at (if defaults? (+ now k) due)
+                              :defaults? (boolean defaults?)))))))))
+
+;; Puts back a contract that was partly settled, to come due again.
+(defn reschedule [book c month]
+  (index book (assoc c :due month :at month :defaults? false)))
+
+;; Removes every contract whose bucket has come round and reports it as
+;; {:kind :withdrawn|:default|:due :contract c}. The caller settles them
+;; (pharaoh.contracts/settle for :due) and reschedules partial ones.
+(defn step-month [book now]
+  (let [ids (mapcat val (subseq (:due book) <= now))]
+    {:book (reduce unindex book ids)
+     :events (mapv (fn [id]
+                     (let [c (contract book id)]
+                       {:kind (cond (= :offer (:status c)) :withdrawn
+                                    (:defaults? c) :default
+                                    :else :due)
+                        :contract c}))
+                   (sort ids))}))
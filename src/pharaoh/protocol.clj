@@ -0,0 +1,181 @@
+(ns pharaoh.protocol
+  (:require [clojure.string :as str]
+            [pharaoh.contracts :as ct]
+            [pharaoh.persistence :as ps]
+            [pharaoh.random :as r]
+            [pharaoh.shm :as shm]
+            [pharaoh.timelapse :as tl]
+            [pharaoh.transactions :as tx])
+  (:import [java.io BufferedReader BufferedWriter InputStreamReader
+            OutputStreamWriter Writer]
+           [java.net InetAddress ServerSocket Socket])
+  (:gen-class))
+
+;; A line protocol for driving a game from another program, in place of
+;; DoDebug's SymStore dialog. Each request line is a batch of commands
+;; separated by semicolons; the reply is one line with one result per
+;; command, in order, also separated by semicolons. Clients may write
+;; any number of lines before reading: replies are flushed only when no
+;; more requests are waiting, so a pipelined client costs one write per
+;; burst rather than one per command.
+;;
+;;   buy|sell|keep COMMODITY N     ok N | capped N | error REASON [MAX]
+;;   feed COMMODITY RATE           ok RATE
+;;   plant|spread|quota N          ok N
+;;   borrow N [check]              check pays for a credit check if needed
+;;   repay|hire|fire|obtain N
+;;   accept I                      accept offer I (an index from offers)
+;;   run N                         ok YEAR MONTH [over|won]
+;;   get VAR ...                   values, by C name (gold, slPrice) or key
+;;   offers | pending              EDN vectors of active contracts
+;;   new DIFFICULTY [SEED]         start a fresh game
+;;   quit                          close the session
+;;
+;; A session is {:rng rng :state state}.
+
+(def ^:private order-ops
+  {"buy" :buy "sell" :sell "keep" :keep "feed" :feed
+   "borrow" :borrow "repay" :repay "hire" :hire "fire" :fire
+   "obtain" :obtain "plant" :plant "spread" :spread "quota" :quota})
+
+(def ^:private takes-commodity #{:buy :sell :keep :feed})
+
+(def ^:private var-paths (into {} shm/vars))
+
+(defn- parse-num [s]
+  (try (Double/parseDouble s) (catch Exception _ nil)))
+
+(defn- fmt [v]
+  (if (number? v)
+    (let [d (double v)]
+      (if (and (== d (Math/rint d)) (< (Math/abs d) 1e15))
+        (str (long d))
+        (str d)))
+    (pr-str v)))
+
+(defn- order-reply [{:keys [status reason amount max-amount fee]}]
+  (case status
+    :ok (str "ok " (fmt amount))
+    :capped (str "capped " (fmt amount))
+    (str/join " " (cond-> ["error" (name reason)]
+                    max-amount (conj (fmt max-amount))
+                    fee (conj (fmt fee))))))
+
+(defn- order [op args]
+  (let [[commodity amount] (if (takes-commodity op) args (cons nil args))]
+    {:op op :commodity (some-> commodity keyword)
+     :amount (some-> amount parse-num)
+     :credit-check (= "check" (second args))}))
+
+(defn- run-months [{:keys [rng state] :as session} n]
+  (let [state (loop [state state n n]
+                (if (or (<= n 0) (:game-over state) (:game-won state))
+                  state
+                  (recur (tl/batch-month rng state) (dec n))))]
+    [(assoc session :state state)
+     (str "ok " (:year state) " " (:month state)
+          (cond (:game-over state) " over" (:game-won state) " won" :else ""))]))
+
+(defn- lookup [state var-name]
+  (get-in state (or (var-paths var-name) [(keyword var-name)])))
+
+(defn- contracts [offers]
+  (pr-str (vec (keep-indexed (fn [i c]
+                               (when (:active c)
+                                 (-> (select-keys c [:type :who :what :amount
+                                                     :price :duration])
+                                     (assoc :index i))))
+                             offers))))
+
+(defn- command [{:keys [rng state] :as session} [cmd & args]]
+  (if-let [op (order-ops cmd)]
+    (let [{s :state res :result} (tx/apply-order rng state (order op args))]
+      [(assoc session :state s) (order-reply res)])
+    (case cmd
+      "run" (run-months session (or (some-> (first args) parse-num long) 1))
+      "get" [session (str/join " " (map #(fmt (lookup state %)) args))]
+      "offers" [session (contracts (:cont-offers state))]
+      "pending" [session (contracts (:cont-pend state))]
+      "accept" (let [i (some-> (first args) parse-num long)
+                     result (when i (ct/accept-contract state i))]
+                 (cond
+                   (nil? result) [session "error invalid-index"]
+                   (:error result) [session "error not-accepted"]
+                   :else [(assoc session :state result) "ok"]))
+      "new" (let [rng (if-let [seed (some-> (second args) parse-num long)]
+                        (r/make-rng seed)
+                        rng)]
+              [{:rng rng :state (tl/new-game rng (or (first args) "Normal"))} "ok"])
+      "quit" [(assoc session :quit true) "bye"]
+      [session (str "error unknown-command " cmd)])))
+
+;; An exception's message, kept to one result: no ; or line breaks.
+(defn- error-reply [^Exception e]
+  (str "error " (str/replace (or (.getMessage e) (.getName (class e)))
+                             #"[;\r\n]+" " ")))
+
+;; Returns [session reply-line].
+(defn execute [session line]
+  (loop [session session cmds (str/split line #";") replies []]
+    (if (or (empty? cmds) (:quit session))
+      [session (str/join ";" replies)]
+      (let [words (str/split (str/trim (first cmds)) #"\s+")]
+        (if (= [""] words)
+          (recur session (rest cmds) replies)
+          (let [[session reply] (try
+                                  (command session words)
+                                  (catch Exception e
+                                    [session (error-reply e)]))]
+            (recur session (rest cmds) (conj replies reply))))))))
+
+(defn serve [session ^BufferedReader in ^Writer out]
+  (loop [session session]
+    (when-let [line (.readLine in)]
+      (let [[session reply] (execute session line)]
+        (.write out ^String reply)
+        (.write out "\n")
+        (when-not (.ready in) (.flush out))
+        (when-not (:quit session)
+          (recur session)))))
+  (.flush out))
+
+(defn- listen [port new-session]
+  (with-open [server (ServerSocket. port 50 (InetAddress/getLoopbackAddress))]
+    (loop [n 0]
+      (let [^Socket sock (.accept server)]
+        (doto (Thread. ^Runnable
+                       #(with-open [sock sock]
+                          (.setTcpNoDelay sock true)
+                          (serve (new-session n)
+                                 (BufferedReader. (InputStreamReader. (.getInputStream sock)))
+                                 (BufferedWriter. (OutputStreamWriter. (.getOutputStream sock))
+                                                  65536)))
+                       (str "pharaoh-session-" n))
+          (.setDaemon true)
+          (.start))
+        (recur (inc n))))))
+
+(defn- parse-args [args]
+  (into {} (map (fn [[k v]] [(keyword (str/replace k #"^--" "")) v])
+                (partition 2 args))))
+
+;; clojure -M:protocol [--seed N] [--difficulty D] [--load SAVED-GAME]
+;;                     [--port N]
+;; Without --port the session is stdin/stdout. With it, each connection
+;; to 127.0.0.1:N gets its own game, seeded with the seed plus the
+;; connection number.
+(defn -main [& args]
+  (let [{:keys [seed difficulty load port]} (parse-args args)
+        seed (if seed (Long/parseLong seed) (System/currentTimeMillis))
+        new-session (fn [n]
+                      (let [rng (r/make-rng (+ seed n))]
+                        {:rng rng
+                         :state (if load
+                                  (ps/load-game load)
+                                  (tl/new-game rng (or difficulty "Normal")))}))]
+    (if port
+      (listen (Integer/parseInt port) new-session)
+      (serve (new-session 0)
+             (BufferedReader. (InputStreamReader. System/in))
+             (BufferedWriter. (OutputStreamWriter. System/out) 65536)))
+    (shutdown-agents)))
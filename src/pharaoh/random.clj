@@ -1,5 +1,7 @@
 (ns pharaoh.random
-  (:import [java.util Random]))
+  (:import [java.io ByteArrayInputStream ByteArrayOutputStream
+            ObjectInputStream ObjectOutputStream]
+           [java.util Random]))
 
 (defn make-rng [seed]
   (Random. (long seed)))
@@ -28,3 +30,25 @@
     (if (>= i n)
       best
       (recur (inc i) (max best (uniform rng a b))))))
+
+;; A Random that hands back recorded nextDouble draws in order, so a pick
+;; made later from stored draws chooses what the live pick would have.
+(defn replay [draws]
+  (let [remaining (atom (seq draws))]
+    (proxy [Random] []
+      (nextDouble []
+        (let [d (first @remaining)]
+          (swap! remaining next)
+          (double (or d 0.0)))))))
+
+;; A Random's whole stream position (its seed and any cached gaussian)
+;; as bytes, for checkpoints. restore continues the same stream.
+(defn snapshot ^bytes [^Random rng]
+  (let [out (ByteArrayOutputStream.)]
+    (with-open [o (ObjectOutputStream. out)]
+      (.writeObject o rng))
+    (.toByteArray out)))
+
+(defn restore ^Random [^bytes b]
+  (with-open [in (ObjectInputStream. (ByteArrayInputStream. b))]
+    (.readObject in)))
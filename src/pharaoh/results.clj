@@ -0,0 +1,158 @@
+(ns pharaoh.results
+  (:import [java.util BitSet HashMap]))
+
+;; Ensemble summaries (see pharaoh.ensemble) kept as columns for queries
+;; across many runs. Every run is a row, found by [policy seed level].
+;;   categorical  :policy :level :outcome   a bitmap per value
+;;   binned       :bankrupt-year            a bitmap per year
+;;   numeric      :seed :months :bankrupt-month :gold :py-height
+;;                :net-worth, and [:min v] [:max v] per tracked var:
+;;                a double column with a zone map (min, max and NaN
+;;                count) per block of rows
+;; A query is a vector:
+;;   [:= col v] [:in col vs] [:< col x] [:<= col x] [:> col x] [:>= col x]
+;;   [:between col lo hi] [:and q ...] [:or q ...] [:not q]
+;; and answers with a BitSet of rows. Bitmap columns answer by OR-ing
+;; bitmaps; numeric ones skip blocks whose zone misses the range, take
+;; whole blocks that fall inside it, and scan only the blocks between.
+;; "Stayed above 0.8" is [:> [:min "slHealth"] 0.8].
+
+(def block 4096)
+
+(def ^:private categorical-keys [:policy :level :outcome])
+(def ^:private scalar-keys [:seed :months :bankrupt-month :gold :py-height :net-worth])
+
+(defn- bitmaps [n value-of]
+  (let [m (HashMap.)]
+    (dotimes [i n]
+      (let [v (value-of i)]
+        (when (some? v)
+          (.set ^BitSet (.computeIfAbsent m v (reify java.util.function.Function
+                                                (apply [_ _] (BitSet. n))))
+                i))))
+    (into {} m)))
+
+(defn- numeric [rows f]
+  (let [n (count rows)
+        values (double-array n)
+        blocks (long (Math/ceil (/ n (double block))))
+        lo (double-array blocks Double/POSITIVE_INFINITY)
+        hi (double-array blocks Double/NEGATIVE_INFINITY)
+        nans (long-array blocks)]
+    (dotimes [i n]
+      (let [v (f (nth rows i))
+            v (if (number? v) (double v) Double/NaN)
+            b (quot i block)]
+        (aset values i v)
+        (if (Double/isNaN v)
+          (aset nans b (inc (aget nans b)))
+          (do (aset lo b (min (aget lo b) v))
+              (aset hi b (max (aget hi b) v))))))
+    {:values values :lo lo :hi hi :nans nans}))
+
+(defn build [summaries]
+  (let [rows (vec summaries)
+        n (count rows)
+        tracked (sort (set (mapcat (comp keys :min) rows)))
+        index (HashMap.)]
+    (dotimes [i n]
+      (let [{:keys [policy seed level]} (nth rows i)]
+        (.put index [policy seed level] i)))
+    {:n n
+     :rows rows
+     :index index
+     :bitmaps (into {:bankrupt-year (bitmaps n #(:bankrupt-year (nth rows %)))}
+                    (for [k categorical-keys] [k (bitmaps n #(get (nth rows %) k))]))
+     :numeric (into {}
+                    (concat (for [k scalar-keys] [k (numeric rows k)])
+                            (for [v tracked, side [:min :max]]
+                              [[side v] (numeric rows #(get-in % [side v]))])))}))
+
+(defn lookup [{:keys [^HashMap index rows]} policy seed level]
+  (when-let [i (.get index [policy seed level])]
+    (nth rows i)))
+
+(defn- in-range? [v lo lo-incl? hi hi-incl?]
+  (and (if lo-incl? (>= v lo) (> v lo))
+       (if hi-incl? (<= v hi) (< v hi))))
+
+(defn- numeric-range [{:keys [n]} {:keys [^doubles values ^doubles lo ^doubles hi ^longs nans]}
+                      from from-incl? to to-incl?]
+  (let [out (BitSet. n)]
+    (dotimes [b (alength lo)]
+      (let [start (* b block)
+            end (min n (+ start block))]
+        (cond
+          (or (> (aget lo b) to) (< (aget hi b) from)
+              (and (== (aget lo b) to) (not to-incl?))
+              (and (== (aget hi b) from) (not from-incl?)))
+          nil
+
+          (and (zero? (aget nans b))
+               (in-range? (aget lo b) from from-incl? to to-incl?)
+               (in-range? (aget hi b) from from-incl? to to-incl?))
+          (.set out (int start) (int end))
+
+          :else
+          (loop [i start]
+            (when (< i end)
+              (when (in-range? (aget values i) from from-incl? to to-incl?)
+                (.set out (int i)))
+              (recur (inc i)))))))
+    out))
+
+(defn- bins-range [{:keys [n]} bins from from-incl? to to-incl?]
+  (let [out (BitSet. n)]
+    (doseq [[v ^BitSet bits] bins
+            :when (in-range? v from from-incl? to to-incl?)]
+      (.or out bits))
+    out))
+
+;; Every query names a column the store has; ranges need an ordered one.
+(defn- check-column [store col range?]
+  (cond
+    (not (or (contains? (:bitmaps store) col) (contains? (:numeric store) col)))
+    (throw (ex-info "Unknown column" {:column col}))
+
+    (and range? (some #{col} categorical-keys))
+    (throw (ex-info "Column has no order" {:column col}))))
+
+(defn- column-range [store col from from-incl? to to-incl?]
+  (check-column store col true)
+  (if-let [bins (get-in store [:bitmaps col])]
+    (bins-range store bins from from-incl? to to-incl?)
+    (numeric-range store (get-in store [:numeric col]) from from-incl? to to-incl?)))
+
+(defn- equal-bits [store col v]
+  (check-column store col false)
+  (if-let [^BitSet bits (get-in store [:bitmaps col v])]
+    (.clone bits)
+    (if (and (number? v) (get-in store [:numeric col]))
+      (column-range store col v true v true)
+      (BitSet. (:n store)))))
+
+(def ^:private inf Double/POSITIVE_INFINITY)
+
+(defn query ^BitSet [store [op col & args :as q]]
+  (case op
+    := (equal-bits store col (first args))
+    :in (reduce (fn [^BitSet acc v] (doto acc (.or (equal-bits store col v))))
+                (BitSet. (:n store)) (first args))
+    :< (column-range store col (- inf) true (first args) false)
+    :<= (column-range store col (- inf) true (first args) true)
+    :> (column-range store col (first args) false inf true)
+    :>= (column-range store col (first args) true inf true)
+    :between (column-range store col (first args) true (second args) true)
+    :and (reduce (fn [^BitSet acc sub] (doto acc (.and (query store sub))))
+                 (query store col) args)
+    :or (reduce (fn [^BitSet acc sub] (doto acc (.or (query store sub))))
+                (query store col) args)
+    :not (doto (query store col) (.flip 0 (int (:n store))))
+    (throw (ex-info "Unknown query" {:query q}))))
+
+(defn select [{:keys [rows]} ^BitSet bits]
+  (map #(nth rows %) (take-while #(>= % 0) (iterate #(.nextSetBit bits (int (inc %)))
+                                                     (.nextSetBit bits 0)))))
+
+(defn count-of [store q]
+  (.cardinality (query store q)))
@@ -0,0 +1,68 @@
+(ns pharaoh.scheduler)
+
+;; A hashed timer wheel. PhIdle compared every deadline on every idle
+;; event; here each job sits in the slot for its tick, and expiring only
+;; walks the slots between the last tick seen and now. A job more than
+;; one rotation away stays in its slot until its own rotation comes up.
+
+(defn make-wheel [tick-ms n-slots now]
+  {:tick-ms tick-ms
+   :slots (vec (repeat n-slots #{}))
+   :cursor (quot now tick-ms)
+   :due {}
+   :slot {}})
+
+(defn due-at [wheel id]
+  (get-in wheel [:due id]))
+
+(defn cancel [wheel id]
+  (if-let [i (get-in wheel [:slot id])]
+    (-> wheel
+        (update-in [:slots i] disj id)
+        (update :due dissoc id)
+        (update :slot dissoc id))
+    wheel))
+
+;; Deadlines already behind the cursor land in the cursor's slot, so they
+;; fire on the next expire instead of a rotation later.
+(defn schedule [wheel id at]
+  (let [{:keys [tick-ms cursor slots] :as wheel} (cancel wheel id)
+        i (mod (max (quot at tick-ms) cursor) (count slots))]
+    (-> wheel
+        (update-in [:slots i] conj id)
+        (assoc-in [:due id] at)
+        (assoc-in [:slot id] i))))
+
+(defn next-due [wheel]
+  (when (seq (:due wheel))
+    (apply min (vals (:due wheel)))))
+
+;; Returns [wheel ids]: the jobs due at or before now, earliest first.
+(defn expire [{:keys [tick-ms slots cursor due] :as wheel} now]
+  (let [target (quot now tick-ms)
+        n (count slots)
+        ticks (range cursor (inc (min target (+ cursor n -1))))
+        fired (->> ticks
+                   (mapcat #(get slots (mod % n)))
+                   (filter #(<= (due %) now))
+                   (sort-by (juxt due str)))]
+    [(assoc (reduce cancel wheel fired) :cursor (max cursor target))
+     (vec fired)]))
+
+;; Jobs are {id {:run (fn [app now] app) :next (fn [app now] at-or-nil)}}.
+;; The app keeps its wheel in :timers. After any change to the app the
+;; wheel is brought in line with each job's :next; nil means not pending.
+(defn sync-jobs [wheel jobs app now]
+  (reduce-kv (fn [w id {next-at :next}]
+               (let [at (next-at app now)]
+                 (cond
+                   (nil? at) (cancel w id)
+                   (= at (due-at w id)) w
+                   :else (schedule w id at))))
+             wheel jobs))
+
+(defn run-due [app jobs now]
+  (let [[wheel ids] (expire (:timers app) now)
+        app (reduce (fn [app id] ((:run (jobs id)) app now))
+                    (assoc app :timers wheel) ids)]
+    (assoc app :timers (sync-jobs (:timers app) jobs app now))))
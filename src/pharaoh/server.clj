@@ -0,0 +1,257 @@
+(ns pharaoh.server
+  (:require [clojure.string :as str]
+            [pharaoh.protocol :as proto]
+            [pharaoh.random :as r]
+            [pharaoh.timelapse :as tl]
+            [pharaoh.world :as world])
+  (:import [java.io BufferedReader BufferedWriter InputStreamReader
+            OutputStreamWriter Writer]
+           [java.net InetAddress ServerSocket Socket]
+           [java.util.concurrent Callable ExecutorService Executors Future
+            ScheduledExecutorService ThreadFactory TimeUnit]
+           [java.util.concurrent.atomic AtomicLong])
+  (:gen-class))
+
+;; Many player sessions in one world, served over loopback sockets with
+;; the pharaoh.protocol commands. Sessions share the markets (prices,
+;; supply, demand, production, inflation) and the contract players.
+;;
+;; Sessions are split across shards, each a single thread that owns its
+;; sessions outright: a session's commands and its monthly run are all
+;; queued to its shard, so nothing is locked. Trades go against the
+;; session's copy of the market as of the last tick. On each tick every
+;; shard runs its sessions' month in parallel and reports their net
+;; purchases; the server sums them in shard order, clears the market
+;; once (pharaoh.world/clear-market) and hands the new market to every
+;; session. Months only pass on the tick, so run and new are refused.
+;;
+;; Commands keep running between a shard's month and the new market
+;; reaching it. Each session therefore keeps :basis, the supply its
+;; trades are counted from: a trade in that gap stays pending in the
+;; published supply and is reported on the next tick.
+
+(def ^:private scheduled #{"run" "new"})
+
+(defn- daemon-factory [prefix]
+  (let [n (AtomicLong.)]
+    (reify ThreadFactory
+      (newThread [_ r]
+        (doto (Thread. ^Runnable r (str prefix (.getAndIncrement n)))
+          (.setDaemon true))))))
+
+;; :scale is the number of kingdoms the shared market is sized for.
+(defn make-server
+  ([] (make-server {}))
+  ([{:keys [shards seed difficulty scale]
+     :or {shards (.availableProcessors (Runtime/getRuntime))
+          seed 1 difficulty "Normal" scale 100}}]
+   (let [s0 (tl/new-game (r/make-rng seed) difficulty)]
+     {:seed seed :difficulty difficulty
+      :rng (r/make-rng seed)
+      :world-growth (:world-growth s0)
+      :players (:players s0)
+      :market (atom (world/scale-market (select-keys s0 world/market-keys) scale))
+      :month (atom 0)
+      :next-id (AtomicLong.)
+      :shards (vec (for [i (range shards)]
+                     {:pool (Executors/newSingleThreadExecutor
+                              (daemon-factory (str "pharaoh-shard-" i "-")))
+                      :sessions (atom (sorted-map))}))})))
+
+(defn- shard-of [{:keys [shards]} id]
+  (nth shards (mod id (count shards))))
+
+(defn- on-shard ^Future [shard f]
+  (.submit ^ExecutorService (:pool shard) ^Callable f))
+
+(defn- call-on [server id f]
+  (let [shard (shard-of server id)]
+    (.get (on-shard shard #(f (:sessions shard))))))
+
+(defn join! [{:keys [seed difficulty players market ^AtomicLong next-id] :as server}]
+  (let [id (.getAndIncrement next-id)]
+    (call-on server id
+             (fn [sessions]
+               (let [rng (r/make-rng (+ seed 1 id))
+                     m @market
+                     state (-> (tl/new-game rng difficulty)
+                               (merge m)
+                               (assoc :players players))]
+                 (swap! sessions assoc id {:id id :rng rng :state state
+                                           :basis (:supply m)}))))
+    id))
+
+(defn leave! [server id]
+  (call-on server id #(swap! % dissoc id)))
+
+(defn session [server id]
+  (call-on server id #(get @% id)))
+
+(defn- execute [session line]
+  (reduce (fn [[session replies] cmd]
+            (let [word (first (str/split (str/trim cmd) #"\s+"))]
+              (cond
+                (:quit session) (reduced [session replies])
+                (= "" word) [session replies]
+                (scheduled word) [session (conj replies "error scheduled")]
+                :else (let [[s reply] (proto/execute session cmd)]
+                        [s (conj replies reply)]))))
+          [session []]
+          (str/split line #";")))
+
+;; Runs one request line for a session; returns [reply quit?].
+(defn command! [server id line]
+  (call-on server id
+           (fn [sessions]
+             (let [[s replies] (execute (get @sessions id) line)]
+               (swap! sessions assoc id (dissoc s :quit))
+               [(str/join ";" replies) (boolean (:quit s))]))))
+
+(defn- net-purchases [{:keys [basis state]}]
+  (into {} (map (fn [[c v]] [c (- v (get-in state [:supply c]))]) basis)))
+
+;; A session's month resets its basis to the supply the month left, so
+;; trades made before the market is published are counted from there.
+(defn- run-shard [sessions]
+  (reduce (fn [net [id {:keys [rng state] :as s}]]
+            (if (or (:game-over state) (:game-won state))
+              net
+              (let [state (tl/batch-month rng state)]
+                (swap! sessions update id assoc :state state :basis (:supply state))
+                (merge-with + net (net-purchases s)))))
+          {} @sessions))
+
+(defn- publish [sessions market]
+  (swap! sessions
+         (fn [m]
+           (into (sorted-map)
+                 (map (fn [[id s]]
+                        (let [pending (net-purchases s)
+                              supply (into {} (map (fn [[c v]] [c (- v (get pending c 0.0))]))
+                                           (:supply market))]
+                          [id (assoc s
+                                     :state (assoc (merge (:state s) market) :supply supply)
+                                     :basis (:supply market))])))
+                 m))))
+
+(defn- on-every-shard [{:keys [shards]} f]
+  (mapv #(.get ^Future %)
+        (mapv (fn [shard] (on-shard shard #(f (:sessions shard)))) shards)))
+
+;; One world month for every session.
+(defn tick! [{:keys [rng market world-growth month] :as server}]
+  (let [m @market
+        net (reduce #(merge-with + %1 %2) {} (on-every-shard server run-shard))
+        cleared (world/clear-market rng m net world-growth)]
+    (reset! market cleared)
+    (on-every-shard server #(publish % cleared))
+    (swap! month inc)
+    net))
+
+(defn start! [server tick-ms]
+  (let [ticker (Executors/newSingleThreadScheduledExecutor (daemon-factory "pharaoh-tick-"))]
+    (.scheduleAtFixedRate ticker
+                          ^Runnable #(try (tick! server)
+                                          (catch Throwable t
+                                            (binding [*out* *err*]
+                                              (println "tick failed:" (.getMessage t)))))
+                          (long tick-ms) (long tick-ms) TimeUnit/MILLISECONDS)
+    (assoc server :ticker ticker)))
+
+(defn stop! [{:keys [shards ticker]}]
+  (when ticker (.shutdownNow ^ScheduledExecutorService ticker))
+  (doseq [{:keys [pool]} shards] (.shutdown ^ExecutorService pool)))
+
+(defn serve [server ^BufferedReader in ^Writer out]
+  (let [id (join! server)]
+    (try
+      (loop []
+        (when-let [line (.readLine in)]
+          (let [[reply quit?] (command! server id line)]
+            (.write out ^String reply)
+            (.write out "\n")
+            (when-not (.ready in) (.flush out))
+            (when-not quit? (recur)))))
+      (.flush out)
+      (finally (leave! server id)))))
+
+(defn- listen [server port]
+  (with-open [ss (ServerSocket. port 1024 (InetAddress/getLoopbackAddress))]
+    (loop []
+      (let [^Socket sock (.accept ss)]
+        (doto (Thread. ^Runnable
+                       #(with-open [sock sock]
+                          (.setTcpNoDelay sock true)
+                          (serve server
+                                 (BufferedReader. (InputStreamReader. (.getInputStream sock)))
+                                 (BufferedWriter. (OutputStreamWriter. (.getOutputStream sock)))))
+                       "pharaoh-connection")
+          (.setDaemon true)
+          (.start))
+        (recur)))))
+
+;; Scripted load: each client sends the same few lines, reading every
+;; reply, and the latencies of all clients are pooled.
+(def ^:private load-script
+  ["get year month gold wtPrice"
+   "buy wheat 100;sell wheat 100"
+   "feed slaves 3;plant 10;offers"])
+
+(defn- run-client [port lines]
+  (with-open [sock (Socket. (InetAddress/getLoopbackAddress) (int port))]
+    (.setTcpNoDelay sock true)
+    (let [in (BufferedReader. (InputStreamReader. (.getInputStream sock)))
+          out (BufferedWriter. (OutputStreamWriter. (.getOutputStream sock)))]
+      (loop [i 0 times (transient [])]
+        (if (< i lines)
+          (let [t0 (System/nanoTime)]
+            (.write out ^String (nth load-script (mod i (count load-script))))
+            (.write out "\n")
+            (.flush out)
+            (.readLine in)
+            (recur (inc i) (conj! times (- (System/nanoTime) t0))))
+          (do (.write out "quit\n")
+              (.flush out)
+              (persistent! times)))))))
+
+(defn load-test [port clients lines]
+  (let [pool (Executors/newFixedThreadPool (int clients) (daemon-factory "pharaoh-client-"))
+        t0 (System/nanoTime)
+        times (try
+                (->> (.invokeAll pool ^java.util.Collection
+                                 (vec (repeat clients ^Callable #(run-client port lines))))
+                     (mapcat #(.get ^Future %))
+                     sort
+                     vec)
+                (finally (.shutdown pool)))
+        secs (/ (- (System/nanoTime) t0) 1e9)
+        pct (fn [q] (/ (nth times (min (dec (count times)) (long (* q (count times))))) 1e6))]
+    (println (format "%d clients, %d requests in %.2f s: %.0f req/s"
+                     clients (count times) secs (/ (count times) secs)))
+    (println (format "latency ms  p50 %.2f  p99 %.2f  max %.2f"
+                     (pct 0.5) (pct 0.99) (pct 1.0)))))
+
+(defn- parse-args [args]
+  (into {} (map (fn [[k v]] [(keyword (str/replace k #"^--" "")) v])
+                (partition 2 args))))
+
+;; clojure -M:server [--port N] [--shards N] [--tick-ms N] [--seed N]
+;;                   [--difficulty D] [--scale N]
+;; clojure -M:server --load N [--port N] [--lines N]
+;; The second form is the load client: N scripted sessions against a
+;; running server.
+(defn -main [& args]
+  (let [{:keys [port shards tick-ms seed difficulty scale load lines]} (parse-args args)
+        port (if port (Integer/parseInt port) 7777)
+        num #(Long/parseLong %)]
+    (if load
+      (load-test port (num load) (if lines (num lines) 1000))
+      (let [server (cond-> {}
+                     shards (assoc :shards (num shards))
+                     seed (assoc :seed (num seed))
+                     difficulty (assoc :difficulty difficulty)
+                     scale (assoc :scale (num scale)))
+            server (start! (make-server server) (if tick-ms (num tick-ms) 10000))]
+        (try (listen server port)
+             (finally (stop! server)))))
+    (shutdown-agents)))
@@ -0,0 +1,233 @@
+(ns pharaoh.shm
+  (:require [clojure.string :as str]
+            [pharaoh.commodities :as cm]
+            [pharaoh.simulation :as sim])
+  (:import [java.io RandomAccessFile]
+           [java.lang.invoke VarHandle]
+           [java.nio ByteBuffer ByteOrder MappedByteBuffer]
+           [java.nio.channels FileChannel$MapMode]
+           [java.nio.charset StandardCharsets])
+  (:gen-class))
+
+;; Live state for external dashboards. The writer maps a file (on Linux,
+;; one under /dev/shm) and after each month copies the varSyms variables,
+;; the pending contracts and the phase timings into it. Any number of
+;; viewers map the same file read-only. A sequence word guards the data:
+;; the writer makes it odd before writing and even after, and a reader
+;; retries until it sees the same even value on both sides of its copy.
+;; Publishing is plain stores into the mapping, with no system calls.
+;;
+;; Layout, little-endian:
+;;   0  magic "PHARAOH1"       8 bytes
+;;   8  version                int
+;;   12 var count              int
+;;   16 phase count            int
+;;   20 contract slots         int
+;;   24 seq                    long
+;;   32 names offset           int   (NUL-separated var then phase names)
+;;   36 data offset            int
+;;   data: vars as doubles, phase ns as longs, pending count as long,
+;;         then per slot: type who what amount price duration as doubles
+
+;; C: varSyms[], by the names the C viewer used.
+(def vars
+  [["creditLimit" [:credit-limit]] ["creditLower" [:credit-lower]]
+   ["creditRating" [:credit-rating]] ["gold" [:gold]] ["horses" [:horses]]
+   ["hsHealth" [:hs-health]] ["loan" [:loan]] ["lnFallow" [:ln-fallow]]
+   ["lnGrown" [:ln-grown]] ["lnRipe" [:ln-ripe]] ["lnSewn" [:ln-sewn]]
+   ["manure" [:manure]] ["overseers" [:overseers]] ["ovPress" [:ov-press]]
+   ["oxen" [:oxen]] ["oxHealth" [:ox-health]] ["pyStones" [:py-stones]]
+   ["slaves" [:slaves]] ["slHealth" [:sl-health]] ["wheat" [:wheat]]
+   ["wtGrown" [:wt-grown]] ["wtRipe" [:wt-ripe]] ["wtSewn" [:wt-sewn]]
+   ["month" [:month]] ["year" [:year]] ["hsFeedRt" [:hs-feed-rt]]
+   ["lnToSew" [:ln-to-sew]] ["mnToSprd" [:mn-to-sprd]]
+   ["oxFeedRt" [:ox-feed-rt]] ["pyQuota" [:py-quota]] ["pyBase" [:py-base]]
+   ["pyHeight" [:py-height]] ["slFeedRt" [:sl-feed-rt]]
+   ["olWt" [:old-wheat]] ["olSl" [:old-slaves]] ["olHs" [:old-horses]]
+   ["olOx" [:old-oxen]] ["olMn" [:old-manure]] ["oldGold" [:old-gold]]
+   ["wtPrice" [:prices :wheat]] ["slPrice" [:prices :slaves]]
+   ["hsPrice" [:prices :horses]] ["oxPrice" [:prices :oxen]]
+   ["mnPrice" [:prices :manure]] ["lnPrice" [:prices :land]]
+   ["ovPay" [:ov-pay]] ["inflation" [:inflation]] ["banker" [:banker]]
+   ["goodGuy" [:good-guy]] ["badGuy" [:bad-guy]] ["dumbGuy" [:dumb-guy]]
+   ["worldGrowth" [:world-growth]]
+   ["wtSupply" [:supply :wheat]] ["wtDemand" [:demand :wheat]]
+   ["wtProduction" [:production :wheat]]
+   ["slSupply" [:supply :slaves]] ["slDemand" [:demand :slaves]]
+   ["slProduction" [:production :slaves]]
+   ["hsSupply" [:supply :horses]] ["hsDemand" [:demand :horses]]
+   ["hsProduction" [:production :horses]]
+   ["oxSupply" [:supply :oxen]] ["oxDemand" [:demand :oxen]]
+   ["oxProduction" [:production :oxen]]
+   ["mnSupply" [:supply :manure]] ["mnDemand" [:demand :manure]]
+   ["mnProduction" [:production :manure]]
+   ["lnSupply" [:supply :land]] ["lnDemand" [:demand :land]]
+   ["lnProduction" [:production :land]]])
+
+(def contract-slots 10)
+
+(def ^:private magic "PHARAOH1")
+(def ^:private version 1)
+(def ^:private seq-at 24)
+(def contract-fields 6)
+
+(defn- names-block ^bytes []
+  (-> (str/join "\u0000" (concat (map first vars) (map name sim/phase-names)))
+      (str "\u0000")
+      (.getBytes StandardCharsets/UTF_8)))
+
+(defn- layout []
+  (let [names (names-block)
+        data-at (* 8 (quot (+ 40 (alength names) 7) 8))
+        phases-at (+ data-at (* 8 (count vars)))
+        pend-at (+ phases-at (* 8 (count sim/phase-names)))]
+    {:names names :data-at data-at :phases-at phases-at :pend-at pend-at
+     :size (+ pend-at 8 (* 8 contract-fields contract-slots))}))
+
+(defn- map-file ^MappedByteBuffer [path mode size]
+  (with-open [f (RandomAccessFile. (str path) (if (= mode :write) "rw" "r"))]
+    (when (= mode :write) (.setLength f size))
+    (doto (.map (.getChannel f)
+                (if (= mode :write)
+                  FileChannel$MapMode/READ_WRITE
+                  FileChannel$MapMode/READ_ONLY)
+                0 (if (= mode :write) size (.length f)))
+      (.order ByteOrder/LITTLE_ENDIAN))))
+
+(defn default-path []
+  (str (if (.isDirectory (java.io.File. "/dev/shm"))
+         "/dev/shm"
+         (System/getProperty "java.io.tmpdir"))
+       "/pharaoh-" (.pid (ProcessHandle/current))))
+
+(defn- put-bytes [^ByteBuffer buf at ^bytes bs]
+  (dotimes [i (alength bs)]
+    (.put buf (int (+ at i)) (aget bs i))))
+
+(defn writer
+  ([] (writer (default-path)))
+  ([path]
+   (let [{:keys [names data-at size] :as lay} (layout)
+         buf (map-file path :write size)]
+     (put-bytes buf 0 (.getBytes ^String magic StandardCharsets/US_ASCII))
+     (.putInt buf 8 (int version))
+     (.putInt buf 12 (count vars))
+     (.putInt buf 16 (count sim/phase-names))
+     (.putInt buf 20 (int contract-slots))
+     (.putLong buf (int seq-at) 0)
+     (.putInt buf 32 40)
+     (.putInt buf 36 (int data-at))
+     (put-bytes buf 40 names)
+     (assoc lay :path (str path) :buf buf :counter (long-array 1)))))
+
+(defn- num-at [state path]
+  (let [v (get-in state path)]
+    (if (number? v) (double v) Double/NaN)))
+
+(defn contract-row [{:keys [type who what amount price duration]}]
+  [(if (= type :buy) 0.0 1.0) (double who)
+   (double (cm/code what))
+   (double amount) (double price) (double duration)])
+
+(defn- write-data [{:keys [^ByteBuffer buf data-at phases-at pend-at]}
+                   state ^longs phase-ns]
+  (loop [i 0 vs (seq vars)]
+    (when vs
+      (.putDouble buf (int (+ data-at (* 8 i))) (double (num-at state (second (first vs)))))
+      (recur (inc i) (next vs))))
+  (dotimes [i (count sim/phase-names)]
+    (.putLong buf (int (+ phases-at (* 8 i))) (if phase-ns (aget phase-ns i) 0)))
+  (let [pending (take contract-slots (filter :active (:cont-pend state)))]
+    (.putLong buf (int pend-at) (long (count pending)))
+    (loop [i 0 cs (seq pending)]
+      (when cs
+        (let [base (+ pend-at 8 (* 8 contract-fields i))]
+          (doseq [[j v] (map-indexed vector (contract-row (first cs)))]
+            (.putDouble buf (int (+ base (* 8 j))) (double v))))
+        (recur (inc i) (next cs))))))
+
+;; Only one thread may publish through a writer. The fences keep the
+;; data stores between the two sequence stores.
+(defn publish!
+  ([w state] (publish! w state nil))
+  ([{:keys [^ByteBuffer buf ^longs counter] :as w} state phase-ns]
+   (let [s (inc (aget counter 0))]
+     (.putLong buf (int seq-at) s)
+     (VarHandle/storeStoreFence)
+     (write-data w state phase-ns)
+     (VarHandle/releaseFence)
+     (.putLong buf (int seq-at) (inc s))
+     (aset counter 0 (inc s)))))
+
+(defn- read-names [^ByteBuffer buf at n]
+  (loop [i at names [] cur (java.io.ByteArrayOutputStream.)]
+    (if (= (count names) n)
+      names
+      (let [b (.get buf (int i))]
+        (if (zero? b)
+          (recur (inc i) (conj names (.toString cur "UTF-8"))
+                 (java.io.ByteArrayOutputStream.))
+          (do (.write cur (int b)) (recur (inc i) names cur)))))))
+
+(defn reader [path]
+  (let [buf (map-file path :read 0)
+        m (byte-array 8)]
+    (dotimes [i 8] (aset m i (.get buf (int i))))
+    (when-not (= magic (String. m StandardCharsets/US_ASCII))
+      (throw (ex-info "Not a pharaoh state segment" {:path (str path)})))
+    (let [n-vars (.getInt buf 12)
+          n-phases (.getInt buf 16)
+          names (read-names buf (.getInt buf 32) (+ n-vars n-phases))
+          data-at (.getInt buf 36)]
+      {:buf buf :version (.getInt buf 8)
+       :vars (subvec names 0 n-vars)
+       :phases (mapv keyword (subvec names n-vars))
+       :slots (.getInt buf 20)
+       :data-at data-at
+       :phases-at (+ data-at (* 8 n-vars))
+       :pend-at (+ data-at (* 8 n-vars) (* 8 n-phases))})))
+
+(defn- copy-out [{:keys [^ByteBuffer buf vars phases slots data-at phases-at pend-at]}]
+  (let [n (min slots (max 0 (.getLong buf (int pend-at))))]
+    {:vars (into {} (map-indexed (fn [i nm] [nm (.getDouble buf (int (+ data-at (* 8 i))))])
+                                 vars))
+     :phase-ns (into {} (map-indexed (fn [i p] [p (.getLong buf (int (+ phases-at (* 8 i))))])
+                                     phases))
+     :pending (vec (for [i (range n)
+                         :let [base (+ pend-at 8 (* 8 contract-fields i))
+                               [typ who what amount price duration]
+                               (mapv #(.getDouble buf (int (+ base (* 8 %))))
+                                     (range contract-fields))]]
+                     {:type (if (zero? typ) :buy :sell) :who (long who)
+                      :what (get cm/codes (long what))
+                      :amount amount :price price :duration (long duration)}))}))
+
+;; A consistent copy of the latest month, or nil before the first publish.
+(defn sample [{:keys [^ByteBuffer buf] :as rd}]
+  (loop []
+    (let [s0 (.getLong buf (int seq-at))]
+      (VarHandle/acquireFence)
+      (if (odd? s0)
+        (do (Thread/onSpinWait) (recur))
+        (let [data (copy-out rd)]
+          (VarHandle/loadLoadFence)
+          (cond
+            (not= s0 (.getLong buf (int seq-at))) (recur)
+            (zero? s0) nil
+            :else (assoc data :seq s0)))))))
+
+;; clojure -M -m pharaoh.shm PATH [INTERVAL-MS]
+;; A minimal viewer: prints a few variables each time the state changes.
+(defn -main [path & [interval]]
+  (let [rd (reader path)
+        ms (if interval (Long/parseLong interval) 500)]
+    (loop [last-seq -1]
+      (let [{:keys [seq vars phase-ns pending]} (sample rd)
+            seen (or seq last-seq)]
+        (when (and seq (not= seq last-seq))
+          (println (format "Year %.0f month %.0f  gold %.0f  loan %.0f  pyramid %.1f  pending %d  month %.0f us"
+                           (vars "year") (vars "month") (vars "gold") (vars "loan")
+                           (vars "pyHeight") (count pending)
+                           (/ (reduce + (vals phase-ns)) 1e3))))
+        (Thread/sleep ms)
+        (recur seen)))))
@@ -1,11 +1,13 @@
 (ns pharaoh.simulation
-  (:require [pharaoh.contracts :as ct]
+  (:require [pharaoh.commodities :as cm]
+            [pharaoh.contracts :as ct]
             [pharaoh.economy :as ec]
             [pharaoh.events :as ev]
             [pharaoh.feeding :as fd]
             [pharaoh.health :as hl]
             [pharaoh.loans :as ln]
             [pharaoh.messages :as msg]
+            [pharaoh.notices :as nt]
             [pharaoh.overseers :as ov]
             [pharaoh.planting :as pl]
             [pharaoh.pyramid :as py]
@@ -28,7 +30,7 @@
 
 (defn- compute-workload [state rng]
   (let [{:keys [req-work avg-py-height]} (wk/required-work rng state)
-        cap (wk/slave-capacity rng state)
+        cap (wk/slave-capacity-core rng state)
         {:keys [wk-sl wk-deff-sl sl-eff] :as eff}
         (wk/compute-efficiency (:slaves state) (:max-wk-sl cap) req-work)]
     (merge state cap eff
@@ -104,23 +106,10 @@
 
 (defn- apply-market [state rng]
   (let [inflation (ec/update-inflation rng (:inflation state))
-        update-p (fn [state k]
-                   (update-in state [:prices k] #(ec/update-price rng % inflation)))
-        state (reduce update-p state [:wheat :land :horses :oxen :slaves :manure])
+        state (cm/update-prices rng state inflation)
         ov-pay (* (:ov-pay state) (r/abs-gaussian rng (+ 1.0 inflation) 0.02))
-        interest (* (:interest state) (r/abs-gaussian rng (+ 1.0 inflation) 0.02))
-        update-commodity (fn [state k]
-                           (let [cm {:supply (get-in state [:supply k])
-                                     :demand (get-in state [:demand k])
-                                     :production (get-in state [:production k])
-                                     :price (get-in state [:prices k])}
-                                 result (ec/adjust-production rng cm (:world-growth state))]
-                             (-> state
-                                 (assoc-in [:supply k] (:supply result))
-                                 (assoc-in [:demand k] (:demand result))
-                                 (assoc-in [:production k] (:production result))
-                                 (assoc-in [:prices k] (:price result)))))]
-    (-> (reduce update-commodity state [:wheat :manure :slaves :horses :oxen :land])
+        interest (* (:interest state) (r/abs-gaussian rng (+ 1.0 inflation) 0.02))]
+    (-> (cm/adjust-markets rng state (:world-growth state))
         (assoc :inflation inflation :ov-pay ov-pay :interest interest))))
 
 (defn- check-overseers-unpaid [state rng]
@@ -161,43 +150,60 @@
        (ct/contract-progress rng)
        (ct/new-offers rng)))
 
-(defn- update-net-worth [state]
-  (let [nw (ec/net-worth state)
-        debt-asset (if (and (pos? nw) (pos? (:loan state)))
-                     (/ (:loan state) nw) 0)]
-    (assoc state :net-worth (- nw (:loan state)) :debt-asset debt-asset)))
+;; C: RunMonth, in phases so each one can be timed
+(def ^:private month-phases
+  [[:date       (fn [_ s] (advance-date s))]
+   [:workload   (fn [rng s] (compute-workload s rng))]
+   [:feeding    (fn [rng s] (compute-feeding s rng))]
+   [:planting   (fn [rng s] (apply-planting s rng))]
+   [:population (fn [rng s] (-> s apply-populations (apply-health rng)))]
+   [:pyramid    (fn [_ s] (-> s apply-pyramid apply-overseer-stress))]
+   [:market     (fn [rng s] (apply-market s rng))]
+   [:costs      (fn [rng s] (apply-costs s rng))]
+   [:contracts  (fn [rng s] (process-contracts s rng))]
+   [:loans      (fn [rng s] (-> s
+                                (check-overseers-unpaid rng)
+                                apply-loan-interest
+                                apply-credit-update
+                                check-emergency-loan
+                                (check-foreclosure rng)
+                                (check-debt-warning rng)))]
+   [:end        (fn [_ s] (-> s check-win (assoc :wk-addition 0.0)))]])
+
+(def phase-names (mapv first month-phases))
+
+;; When bound to a long-array, run-month stores the nanoseconds each
+;; phase took in it, in phase-names order.
+(def ^:dynamic *phase-ns* nil)
+
+(defn- run-month-timed [rng state ^longs times]
+  (loop [s state i 0]
+    (if (< i (count month-phases))
+      (let [t0 (System/nanoTime)
+            s ((second (month-phases i)) rng s)]
+        (aset times i (- (System/nanoTime) t0))
+        (recur s (inc i)))
+      s)))
 
 (defn run-month [rng state]
-  (-> state
-      advance-date
-      (compute-workload rng)
-      (compute-feeding rng)
-      (apply-planting rng)
-      apply-populations
-      (apply-health rng)
-      apply-pyramid
-      apply-overseer-stress
-      (apply-market rng)
-      (apply-costs rng)
-      (process-contracts rng)
-      (check-overseers-unpaid rng)
-      apply-loan-interest
-      apply-credit-update
-      check-emergency-loan
-      update-net-worth
-      (check-foreclosure rng)
-      (check-debt-warning rng)
-      check-win
-      (assoc :wk-addition 0.0)))
+  (if-let [times *phase-ns*]
+    (run-month-timed rng state times)
+    (reduce (fn [s [_ f]] (f rng s)) state month-phases)))
 
 (defn- pop-contract-msg [state]
   (if (and (not (map? (:message state)))
            (seq (:contract-msgs state)))
-    (let [[msg & rest] (:contract-msgs state)]
-      (assoc state :message msg :contract-msgs (vec rest)))
+    (nt/pop-next state)
     state))
 
-(defn do-run [rng state]
+(defn- event-notice [rng etype]
+  (let [draws (ev/message-draws rng etype)
+        face (long (r/uniform rng 0 4))]
+    {:event :random :type etype :draws draws :face face}))
+
+;; One month without building any text: a random event leaves its notice
+;; in :notice for whoever displays it.
+(defn advance [rng state]
   (let [state (record-old state)
         event? (< (r/uniform rng 0.0 8.0) 1.0)
         [state etype] (if event?
@@ -206,8 +212,12 @@
                         [state nil])
         state (run-month rng state)]
     (-> (if etype
-          (let [msg (ev/event-message rng etype nil)
-                face (long (r/uniform rng 0 4))]
-            (assoc state :message {:text (or msg "Something happened...") :face face}))
-          (pop-contract-msg state))
+          (assoc state :notice (event-notice rng etype))
+          state)
         (assoc :dirty true))))
+
+(defn do-run [rng state]
+  (let [state (advance rng state)]
+    (if-let [notice (:notice state)]
+      (-> state (dissoc :notice) (assoc :message (nt/render state notice)))
+      (pop-contract-msg state))))
@@ -83,8 +83,7 @@
 
    ;; Computed values (filled during simulation)
    :sl-eff 1.0 :wt-eff 1.0
-   :sl-fed 0.0 :ox-fed 0.0 :hs-fed 0.0
-   :net-worth 0.0 :debt-asset 0.0})
+   :sl-fed 0.0 :ox-fed 0.0 :hs-fed 0.0})
 
 (defn set-difficulty [state difficulty]
   (case difficulty
@@ -0,0 +1,276 @@
+(ns pharaoh.sweep
+  (:require [clojure.edn :as edn]
+            [clojure.java.io :as io]
+            [clojure.string :as str]
+            [pharaoh.ensemble :as en])
+  (:import [java.io BufferedReader BufferedWriter EOFException File
+            InputStreamReader OutputStreamWriter RandomAccessFile]
+           [java.net ServerSocket Socket SocketException]
+           [java.nio ByteOrder MappedByteBuffer]
+           [java.nio.channels FileChannel$MapMode]
+           [java.nio.charset StandardCharsets]
+           [java.util.concurrent ConcurrentHashMap LinkedBlockingQueue TimeUnit])
+  (:gen-class))
+
+;; An ensemble sweep split across worker processes. The coordinator cuts
+;; the run ids into shards and hands them out over TCP, one EDN line
+;; each way:
+;;   coordinator  {:shard n :only [from to] :spec spec :heartbeat-ms t}
+;;                or {:done true}
+;;   worker       {:heartbeat n} every t ms while it plays shard n, then
+;;                {:shard n :results [summary ...]}
+;; Each run's rng is seeded from its own seed, so a summary is the same
+;; whichever worker plays it and however the sweep is cut. A shard whose
+;; worker disconnects, or says nothing for lease-ms, goes back on the
+;; queue; a late duplicate answer is ignored. The coordinator's next
+;; line to a worker carries :accepted, whether its last answer was the
+;; one kept. Workers on the coordinator's machine add the shards kept
+;; from them to a shared file (see progress), one slot each, so the
+;; coordinator can watch the sweep without more traffic and a shard
+;; played twice counts once. Workers on other machines simply connect
+;; to the coordinator's port.
+
+(def ^:private magic "PHSWEEP1")
+(def ^:private slot-at 16)
+(def ^:private slot-fields [:shards :runs :months :won :bankrupt :survived])
+(def ^:private slot-bytes (* 8 (count slot-fields)))
+
+(defn- map-file ^MappedByteBuffer [path size]
+  (with-open [f (RandomAccessFile. (str path) "rw")]
+    (when (pos? size) (.setLength f size))
+    (doto (.map (.getChannel f) FileChannel$MapMode/READ_WRITE 0 (.length f))
+      (.order ByteOrder/LITTLE_ENDIAN))))
+
+(defn create-progress [path slots]
+  (let [buf (map-file path (+ slot-at (* slots slot-bytes)))
+        m (.getBytes ^String magic StandardCharsets/US_ASCII)]
+    (dotimes [i 8] (.put buf (int i) (aget m i)))
+    (.putInt buf 8 (int slots))
+    buf))
+
+;; A worker's totals only ever grow, and each slot has one writer.
+;; Only shards the coordinator kept are added.
+(defn- add-progress! [^MappedByteBuffer buf slot results]
+  (let [base (+ slot-at (* slot slot-bytes))
+        add (fn [k n]
+              (let [at (int (+ base (* 8 (.indexOf ^java.util.List slot-fields k))))]
+                (.putLong buf at (+ (.getLong buf at) (long n)))))
+        outcomes (frequencies (map :outcome results))]
+    (add :runs (count results))
+    (add :months (reduce + (map :months results)))
+    (doseq [k [:won :bankrupt :survived]] (add k (get outcomes k 0)))
+    (add :shards 1)))
+
+;; Totals over every local worker.
+(defn progress [^MappedByteBuffer buf]
+  (let [slots (.getInt buf 8)]
+    (into {} (map-indexed
+               (fn [j k]
+                 [k (reduce + (for [s (range slots)]
+                                (.getLong buf (int (+ slot-at (* s slot-bytes) (* 8 j))))))])
+               slot-fields))))
+
+;; A worker's heartbeats and answer share the connection.
+(defn- send-line [^BufferedWriter out msg]
+  (locking out
+    (.write out (pr-str msg))
+    (.newLine out)
+    (.flush out)))
+
+(defn- shards [n shard-size]
+  (vec (for [from (range 0 n shard-size)] [from (min n (+ from shard-size))])))
+
+;; The worker's answer, skipping heartbeats. Each line renews the lease:
+;; the read times out only after lease-ms of silence.
+(defn- read-answer [^BufferedReader in]
+  (loop []
+    (when-let [msg (some-> (.readLine in) edn/read-string)]
+      (if (:heartbeat msg) (recur) msg))))
+
+;; Serves one worker connection until the sweep is done or the worker
+;; goes away; a shard it held is put back.
+(defn- serve-worker [{:keys [spec cuts ^LinkedBlockingQueue queue ^ConcurrentHashMap results
+                             lease-ms]} ^Socket sock]
+  (with-open [sock sock]
+    (.setSoTimeout sock (int lease-ms))
+    (let [in (BufferedReader. (InputStreamReader. (.getInputStream sock)))
+          out (BufferedWriter. (OutputStreamWriter. (.getOutputStream sock)))
+          reply (fn [msg accepted] (cond-> msg (some? accepted) (assoc :accepted accepted)))]
+      (loop [accepted nil]
+        (let [n (.poll queue 100 TimeUnit/MILLISECONDS)]
+          (cond
+            (= (count cuts) (.size results)) (send-line out (reply {:done true} accepted))
+            (or (nil? n) (.containsKey results n)) (recur accepted)
+            :else
+            ;; Any failure to get an answer (a drop, the lease running
+            ;; out, a line cut short by a crash) puts the shard back.
+            (let [answer (try
+                           (send-line out (reply {:shard n :only (cuts n) :spec spec
+                                                  :heartbeat-ms (max 1 (quot lease-ms 4))}
+                                                 accepted))
+                           (read-answer in)
+                           (catch Exception _ nil))]
+              (if (= n (:shard answer))
+                (recur (nil? (.putIfAbsent results n (:results answer))))
+                (.put queue n)))))))))
+
+;; Starts listening; returns the coordinator. spec must be plain data
+;; (policies by name).
+(defn start-coordinator [spec {:keys [port shard-size lease-ms]
+                               :or {port 0 shard-size 64 lease-ms 600000}}]
+  (let [n (count (en/runs spec))
+        cuts (shards n shard-size)
+        server (ServerSocket. (int port) 256)
+        c {:spec (dissoc spec :threads :telemetry :checkpoint :cancel)
+           :cuts cuts
+           :queue (LinkedBlockingQueue. ^java.util.Collection (range (count cuts)))
+           :results (ConcurrentHashMap.)
+           :lease-ms lease-ms
+           :server server
+           :port (.getLocalPort server)}]
+    (doto (Thread. ^Runnable
+                   #(try
+                      (loop []
+                        (let [sock (.accept server)]
+                          (doto (Thread. ^Runnable (fn [] (serve-worker c sock))
+                                         "pharaoh-sweep-conn")
+                            (.setDaemon true)
+                            (.start))
+                          (recur)))
+                      (catch SocketException _ nil))
+                   "pharaoh-sweep-accept")
+      (.setDaemon true)
+      (.start))
+    c))
+
+;; Blocks until every shard is in; returns all summaries in run order.
+;; Workers that connect later are told the sweep is done until stop!.
+(defn await-results [{:keys [cuts ^ConcurrentHashMap results]}]
+  (while (< (.size results) (count cuts))
+    (Thread/sleep 50))
+  (vec (mapcat #(.get results %) (range (count cuts)))))
+
+(defn stop! [{:keys [^ServerSocket server]}]
+  (.close server))
+
+;; Calls f while another thread tells the coordinator, every every-ms,
+;; that shard n is still being played.
+(defn- with-heartbeat [out n every-ms f]
+  (let [beat (doto (Thread. ^Runnable
+                            #(try
+                               (loop []
+                                 (Thread/sleep (long every-ms))
+                                 (send-line out {:heartbeat n})
+                                 (recur))
+                               (catch InterruptedException _ nil)
+                               (catch java.io.IOException _ nil))
+                            "pharaoh-sweep-heartbeat")
+               (.setDaemon true)
+               (.start))]
+    (try (f)
+         (finally (.interrupt beat)
+                  (.join beat)))))
+
+;; Plays shards for a coordinator until told the sweep is done. With
+;; :progress and :slot, adds each shard the coordinator kept to that
+;; slot of the shared file. Returns only on {:done true}: a connection
+;; the coordinator dropped throws, so the worker's process fails and is
+;; started again.
+(defn work [host port {:keys [threads progress slot]}]
+  (with-open [sock (Socket. ^String host (int port))]
+    (let [in (BufferedReader. (InputStreamReader. (.getInputStream sock)))
+          out (BufferedWriter. (OutputStreamWriter. (.getOutputStream sock)))
+          buf (when progress (map-file progress 0))]
+      (loop [sent nil]
+        (let [line (or (.readLine in)
+                       (throw (EOFException. "Coordinator closed the connection")))
+              {:keys [shard only spec done accepted heartbeat-ms]} (edn/read-string line)]
+          (when (and buf sent accepted) (add-progress! buf slot sent))
+          (when-not done
+            (let [results (with-heartbeat out shard (or heartbeat-ms 60000)
+                            #(en/run (cond-> (assoc spec :only only)
+                                       threads (assoc :threads threads))))]
+              (send-line out {:shard shard :results results})
+              (recur results))))))))
+
+(defn- java-command [port progress slot threads]
+  [(str (System/getProperty "java.home") File/separator "bin" File/separator "java")
+   "-Djava.awt.headless=true"
+   "-cp" (System/getProperty "java.class.path")
+   "clojure.main" "-m" "pharaoh.sweep" "work"
+   "--connect" (str "127.0.0.1:" port)
+   "--progress" (str progress) "--slot" (str slot)
+   "--threads" (str threads)])
+
+;; Runs a sweep on this machine with n worker processes, each on its own
+;; share of the cores, reporting progress every few seconds. A worker
+;; that fails is started again; one that exits cleanly is done.
+(defn sweep [spec {:keys [workers threads] :as opts}]
+  (let [workers (or workers 1)
+        threads (or threads (max 1 (quot (.availableProcessors (Runtime/getRuntime)) workers)))
+        c (start-coordinator spec opts)
+        path (str (System/getProperty "java.io.tmpdir") "/pharaoh-sweep-" (:port c))
+        buf (create-progress path workers)
+        spawn (fn [slot]
+                (-> (ProcessBuilder. ^java.util.List (java-command (:port c) path slot threads))
+                    (.inheritIO)
+                    (.start)))
+        procs (atom (mapv spawn (range workers)))
+        ;; Reports progress and restarts any worker process that failed.
+        reporter (doto (Thread. ^Runnable
+                                #(try
+                                   (loop []
+                                     (Thread/sleep 5000)
+                                     (let [{:keys [runs months]} (progress buf)]
+                                       (println (format "%d of %d runs, %d game-months"
+                                                        runs (count (en/runs spec)) months)))
+                                     (swap! procs (fn [ps]
+                                                    (mapv (fn [slot ^Process p]
+                                                            (if (or (.isAlive p) (zero? (.exitValue p)))
+                                                              p
+                                                              (spawn slot)))
+                                                          (range) ps)))
+                                     (recur))
+                                   (catch InterruptedException _ nil)))
+                   (.setDaemon true)
+                   (.start))]
+    (try
+      (await-results c)
+      (finally
+        (.interrupt reporter)
+        (stop! c)
+        (doseq [^Process p @procs] (.waitFor p 10 TimeUnit/SECONDS) (.destroy p))
+        (io/delete-file path true)))))
+
+(defn- parse-args [args]
+  (into {} (map (fn [[k v]] [(keyword (str/replace k #"^--" "")) v])
+                (partition 2 args))))
+
+;; clojure -M:sweep [--workers N] [--port N] [--shard-size N] [--seeds N]
+;;                  [--months N] [--levels L,...] [--policies P,...]
+;; clojure -M:sweep work --connect HOST:PORT [--threads N]
+;; The first form coordinates, starting N local workers; the second
+;; joins a running coordinator from any machine that can reach it.
+(defn -main [& args]
+  (if (= "work" (first args))
+    (let [{:keys [connect threads progress slot]} (parse-args (rest args))
+          [host port] (str/split connect #":")]
+      (work host (Integer/parseInt port)
+            (cond-> {}
+              threads (assoc :threads (Long/parseLong threads))
+              progress (assoc :progress progress :slot (Long/parseLong slot)))))
+    (let [{:keys [workers port shard-size seeds months levels policies]} (parse-args args)
+          parse #(when % (Long/parseLong %))
+          spec {:policies (str/split (or policies "default") #",")
+                :levels (str/split (or levels "Normal") #",")
+                :seeds (vec (range (or (parse seeds) 100)))
+                :months (or (parse months) 480)}
+          t0 (System/nanoTime)
+          results (sweep spec (cond-> {:workers (or (parse workers) 1)}
+                                port (assoc :port (parse port))
+                                shard-size (assoc :shard-size (parse shard-size))))]
+      (doseq [[outcome n] (sort-by key (frequencies (map :outcome results)))]
+        (println (format "%-9s %d" (name outcome) n)))
+      (println (format "%d runs in %.2f s" (count results)
+                       (/ (- (System/nanoTime) t0) 1e9)))))
+  (shutdown-agents))
@@ -15,6 +15,14 @@
           dx (- x min-x (* i quantum))]
       (+ (y-vector i) (* m dx)))))
 
+;; d(interpolate)/dx: the slope of the segment x falls in, 0 past the ends.
+(defn slope [x {:keys [min-x max-x y-vector]}]
+  (if (or (<= x min-x) (>= x max-x))
+    0.0
+    (let [quantum (/ (- max-x min-x) 10.0)
+          i (min 9 (long (/ (- x min-x) quantum)))]
+      (/ (- (y-vector (inc i)) (y-vector i)) quantum))))
+
 ;; tSeasonYeild: month 1-12 (vars.c)
 (def seasonal-yield
   (make-table 1.0 12.0
@@ -0,0 +1,233 @@
+(ns pharaoh.telemetry
+  (:require [pharaoh.shm :as shm])
+  (:import [java.io DataInputStream BufferedInputStream File FileInputStream RandomAccessFile]
+           [java.nio ByteBuffer ByteOrder]
+           [java.nio.channels FileChannel]
+           [java.nio.charset StandardCharsets]
+           [java.nio.file OpenOption Paths StandardOpenOption]
+           [java.util.concurrent ConcurrentLinkedQueue ExecutorService Executors
+            LinkedBlockingQueue ThreadFactory TimeUnit]
+           [java.util.concurrent.atomic AtomicLong]
+           [java.util.zip Deflater Inflater]))
+
+;; Per-month rows from many games, streamed to a chunked columnar file.
+;; Every worker thread fills its own buffer, so recording takes no lock.
+;; A full buffer is handed as it is to one background thread, which
+;; deflates it straight out of the buffer and appends it to the file;
+;; the buffer then goes back to a free pool. A row is the run id and the
+;; month index (12 * year + month) as int32, then each chosen variable
+;; as float64.
+;;
+;; File layout, little-endian:
+;;   "PHTLM001"  int32 column count  per column: int32 length, UTF-8 name
+;;   chunks:     int32 rows  int32 deflated bytes  deflated data
+;; Inflated, a chunk is column-major: rows int32 run ids, rows int32
+;; months, then rows float64 per variable, in header order.
+
+(def ^:private magic "PHTLM001")
+(def default-rows 4096)
+
+(defn- daemon-factory [name]
+  (reify ThreadFactory
+    (newThread [_ r] (doto (Thread. ^Runnable r ^String name) (.setDaemon true)))))
+
+(defn- row-bytes [n-vars] (+ 8 (* 8 n-vars)))
+
+(defn- header ^ByteBuffer [names]
+  (let [bs (mapv #(.getBytes ^String % StandardCharsets/UTF_8) names)
+        buf (.order (ByteBuffer/allocate (+ 12 (reduce + (map #(+ 4 (alength ^bytes %)) bs))))
+                    ByteOrder/LITTLE_ENDIAN)]
+    (.put buf (.getBytes ^String magic StandardCharsets/US_ASCII))
+    (.putInt buf (count bs))
+    (doseq [^bytes b bs] (.putInt buf (alength b)) (.put buf b))
+    (.flip buf)))
+
+(defn- read-le-int ^long [^DataInputStream in]
+  (Integer/reverseBytes (.readInt in)))
+
+(defn- read-header [^DataInputStream in path]
+  (let [m (byte-array 8)]
+    (.readFully in m)
+    (when-not (= magic (String. m StandardCharsets/US_ASCII))
+      (throw (ex-info "Not a telemetry file" {:path path})))
+    (vec (repeatedly (read-le-int in)
+                     #(let [b (byte-array (read-le-int in))]
+                        (.readFully in b)
+                        (String. b StandardCharsets/UTF_8))))))
+
+(defn- header-bytes [names]
+  (+ 12 (reduce + (map #(+ 4 (alength (.getBytes ^String % StandardCharsets/UTF_8))) names))))
+
+;; Where the last whole chunk of an existing file ends; a chunk cut short
+;; by a crash is dropped. Throws unless the file has these columns.
+(defn- whole-length [path names]
+  (with-open [in (DataInputStream. (BufferedInputStream. (FileInputStream. ^String path)))]
+    (when-not (= names (read-header in path))
+      (throw (ex-info "Telemetry file has other columns" {:path path}))))
+  (with-open [f (RandomAccessFile. ^String path "r")]
+    (let [size (.length f)]
+      (loop [at (long (header-bytes names))]
+        (if (<= (+ at 8) size)
+          (let [len (do (.seek f (+ at 4)) (Integer/reverseBytes (.readInt f)))]
+            (if (<= (+ at 8 len) size)
+              (recur (+ at 8 len))
+              at))
+          at)))))
+
+;; columns are [name path] pairs, as in shm/vars. Each recording thread
+;; holds one buffer, so max-buffers must exceed the number of threads.
+;; With :append, chunks go after those already in an existing file with
+;; the same columns; otherwise the file is started afresh.
+(defn open-writer
+  ([path] (open-writer path shm/vars))
+  ([path columns] (open-writer path columns {}))
+  ([path columns {:keys [rows max-buffers append]
+                       :or {rows default-rows
+                            max-buffers (+ 2 (* 2 (.availableProcessors (Runtime/getRuntime))))}}]
+   (let [names (mapv first columns)
+         kept (when (and append (pos? (.length (File. ^String path))))
+                (whole-length path names))
+         ch (FileChannel/open (Paths/get path (make-array String 0))
+                              (into-array OpenOption (cond-> [StandardOpenOption/CREATE
+                                                              StandardOpenOption/WRITE]
+                                                       (not kept) (conj StandardOpenOption/TRUNCATE_EXISTING))))]
+     (if kept
+       (doto ch (.truncate (long kept)) (.position (long kept)))
+       (.write ch (header names)))
+     {:channel ch
+      :paths (mapv second columns)
+      :rows rows
+      :chunk-bytes (* rows (row-bytes (count columns)))
+      :free (LinkedBlockingQueue.)
+      :allocated (AtomicLong.)
+      :max-buffers max-buffers
+      :recorders (ConcurrentLinkedQueue.)
+      :local (ThreadLocal.)
+      :error (atom nil)
+      :deflater (Deflater. Deflater/BEST_SPEED)
+      :out (.order (ByteBuffer/allocateDirect (+ 1024 (* 2 rows (row-bytes (count columns)))))
+                  ByteOrder/LITTLE_ENDIAN)
+      :exec (Executors/newSingleThreadExecutor (daemon-factory "pharaoh-telemetry"))})))
+
+;; A failed write is reported by the next record! on any thread, and by
+;; close!.
+(defn- check-error [{:keys [error]}]
+  (when-let [t @error]
+    (throw (ex-info "Telemetry write failed" {} t))))
+
+(defn- take-buffer ^ByteBuffer [{:keys [^LinkedBlockingQueue free ^AtomicLong allocated
+                                         max-buffers chunk-bytes] :as w}]
+  (check-error w)
+  (or (.poll free)
+      (if (< (.getAndIncrement allocated) max-buffers)
+        (.order (ByteBuffer/allocateDirect chunk-bytes) ByteOrder/LITTLE_ENDIAN)
+        (.take free))))
+
+(defn- section ^ByteBuffer [^ByteBuffer buf start len]
+  (-> (.duplicate buf) (.limit (int (+ start len))) (.position (int start))))
+
+;; Runs on the telemetry thread: the buffer is deflated in place, one
+;; column section at a time, so a part-filled chunk writes only its rows.
+;; The buffer goes back to the pool even if the write fails, so no
+;; recording thread is left waiting for one.
+(defn- write-chunk [{:keys [^FileChannel channel ^Deflater deflater ^ByteBuffer out
+                            rows paths ^LinkedBlockingQueue free]}
+                    ^ByteBuffer buf n]
+  (try
+    (let [cap (long rows)
+          sections (concat [[0 (* 4 n)] [(* 4 cap) (* 4 n)]]
+                           (for [j (range (count paths))] [(* 8 (+ cap (* j cap))) (* 8 n)]))]
+      (.reset deflater)
+      (.clear out)
+      (.position out 8)
+      (doseq [[start len] sections]
+        (.setInput deflater (section buf start len))
+        (while (not (.needsInput deflater))
+          (.deflate deflater out)))
+      (.finish deflater)
+      (while (not (.finished deflater))
+        (.deflate deflater out))
+      (.putInt out 0 (int n))
+      (.putInt out 4 (int (- (.position out) 8)))
+      (.flip out)
+      (while (.hasRemaining out) (.write channel out)))
+    (finally
+      (.clear buf)
+      (.put free buf))))
+
+(defn- submit-chunk [{:keys [^ExecutorService exec error] :as w} buf n]
+  (.execute exec ^Runnable (fn []
+                             (try (write-chunk w buf n)
+                                  (catch Throwable t (compare-and-set! error nil t))))))
+
+(defn- recorder [{:keys [^ThreadLocal local ^ConcurrentLinkedQueue recorders] :as w}]
+  (or (.get local)
+      (let [r (object-array [(take-buffer w) 0])]
+        (.set local r)
+        (.add recorders r)
+        r)))
+
+;; Appends one row. Safe from any number of threads. Throws once a chunk
+;; has failed to write.
+(defn record! [{:keys [rows paths] :as w} run-id state]
+  (check-error w)
+  (let [^objects r (recorder w)
+        ^ByteBuffer buf (aget r 0)
+        i (long (aget r 1))
+        cap (long rows)]
+    (.putInt buf (int (* 4 i)) (int run-id))
+    (.putInt buf (int (* 4 (+ cap i))) (int (+ (* 12 (:year state)) (:month state))))
+    (loop [j 0 ps (seq paths)]
+      (when ps
+        (let [v (get-in state (first ps))]
+          (.putDouble buf (int (* 8 (+ cap (* j cap) i)))
+                      (if (number? v) (double v) Double/NaN)))
+        (recur (inc j) (next ps))))
+    (if (< (inc i) cap)
+      (aset r 1 (inc i))
+      (do (submit-chunk w buf cap)
+          (aset r 0 (take-buffer w))
+          (aset r 1 0)))))
+
+;; Flushes every thread's part-filled buffer; call once the workers are
+;; done.
+(defn close! [{:keys [^FileChannel channel ^ExecutorService exec
+                      ^ConcurrentLinkedQueue recorders ^Deflater deflater] :as w}]
+  (doseq [^objects r recorders]
+    (when (pos? (long (aget r 1)))
+      (submit-chunk w (aget r 0) (aget r 1))))
+  (.shutdown exec)
+  (.awaitTermination exec Long/MAX_VALUE TimeUnit/NANOSECONDS)
+  (.end deflater)
+  (.close channel)
+  (check-error w))
+
+;; Reads a whole file back: {:columns names :run ints :month ints
+;; :values {name doubles}}. For tests and small files; bigger ones are
+;; read chunk by chunk the same way.
+(defn read-file [path]
+  (with-open [in (DataInputStream. (BufferedInputStream. (FileInputStream. ^String path)))]
+    (let [names (read-header in path)
+          chunks (loop [acc []]
+                   (if (pos? (.available in))
+                     (let [n (read-le-int in)
+                           packed (byte-array (read-le-int in))
+                           _ (.readFully in packed)
+                           raw (byte-array (* n (row-bytes (count names))))
+                           inf (doto (Inflater.) (.setInput packed))]
+                       (.inflate inf raw)
+                       (.end inf)
+                       (recur (conj acc [n (.order (ByteBuffer/wrap raw)
+                                                  ByteOrder/LITTLE_ENDIAN)])))
+                     acc))
+          ints (fn [k] (int-array (for [[n ^ByteBuffer b] chunks i (range n)]
+                                    (.getInt b (int (* 4 (+ (* k n) i)))))))]
+      {:columns names
+       :run (ints 0)
+       :month (ints 1)
+       :values (into {} (map-indexed
+                          (fn [j nm]
+                            [nm (double-array
+                                  (for [[n ^ByteBuffer b] chunks i (range n)]
+                                    (.getDouble b (int (* 8 (+ n (* j n) i))))))])
+                          names))})))
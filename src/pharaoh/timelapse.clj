@@ -0,0 +1,79 @@
+(ns pharaoh.timelapse
+  (:require [clojure.java.io :as io]
+            [pharaoh.neighbors :as nb]
+            [pharaoh.persistence :as ps]
+            [pharaoh.random :as r]
+            [pharaoh.simulation :as sim]
+            [pharaoh.startup :as su]
+            [pharaoh.state :as st]
+            [pharaoh.ui.raster :as ras])
+  (:import [java.io BufferedOutputStream OutputStream]
+           [javax.imageio ImageIO])
+  (:gen-class))
+
+;; Renders one frame per simulated month through the offscreen raster.
+;; A sink is {:write (fn [canvas frame-no]) :close (fn [])}.
+
+;; Binary PPM frames back to back, to a file or a pipe into a video
+;; encoder (ffmpeg -f image2pipe -c:v ppm -i -).
+(defn ppm-sink [^OutputStream out]
+  (let [buf (atom nil)]
+    {:write (fn [canvas _]
+              (let [^ints px (ras/pixels canvas)
+                    n (alength px)
+                    ^bytes b (or @buf (reset! buf (byte-array (* 3 n))))]
+                (dotimes [i n]
+                  (let [p (aget px i)
+                        j (* 3 i)]
+                    (aset b j (unchecked-byte (bit-shift-right p 16)))
+                    (aset b (+ j 1) (unchecked-byte (bit-shift-right p 8)))
+                    (aset b (+ j 2) (unchecked-byte p))))
+                (.write out (.getBytes (format "P6\n%d %d\n255\n"
+                                               (ras/width canvas) (ras/height canvas))
+                                       "US-ASCII"))
+                (.write out b)))
+     :close #(.flush out)}))
+
+(defn png-sink [dir]
+  (.mkdirs (io/file dir))
+  {:write (fn [canvas i]
+            (ImageIO/write ^java.awt.image.BufferedImage (:image canvas) "png"
+                           (io/file dir (format "frame-%05d.png" i))))
+   :close (fn [])})
+
+;; A batch month has no one to read its messages.
+(defn batch-month [rng state]
+  (-> (sim/advance rng state)
+      (dissoc :notice :message)
+      (assoc :contract-msgs [])))
+
+(defn record [rng state months {:keys [write]}]
+  (loop [state state canvas (ras/make-canvas) month 0]
+    (let [canvas (ras/render canvas state)]
+      (write canvas month)
+      (if (or (>= month months) (:game-over state) (:game-won state))
+        state
+        (recur (batch-month rng state) canvas (inc month))))))
+
+(defn new-game [rng difficulty]
+  (:state (su/select-difficulty
+            {:rng rng :state (merge (st/initial-state) (nb/set-men rng))}
+            difficulty)))
+
+(defn- open-sink [out]
+  (cond
+    (= "-" out) (ppm-sink (BufferedOutputStream. System/out (* 1024 1024)))
+    (.endsWith ^String out ".ppm") (let [^OutputStream s (io/output-stream out)]
+                                     (assoc (ppm-sink s) :close #(.close s)))
+    :else (png-sink out)))
+
+;; clojure -M:timelapse SEED MONTHS OUT [SAVED-GAME]
+;; OUT is "-" for a PPM stream on stdout, a .ppm file, or a directory for PNGs.
+(defn -main [seed months out & [saved]]
+  (let [rng (r/make-rng (Long/parseLong seed))
+        state (if saved (ps/load-game saved) (new-game rng "Normal"))
+        sink (open-sink out)]
+    (try
+      (record rng state (Long/parseLong months) sink)
+      (finally ((:close sink))))
+    (shutdown-agents)))
@@ -1,12 +1,12 @@
 (ns pharaoh.trading
-  (:require [pharaoh.random :as r]))
+  (:require [pharaoh.commodities :as cm]
+            [pharaoh.random :as r]))
 
 (def commodity-keys
-  {:wheat :wheat :manure :manure :slaves :slaves
-   :horses :horses :oxen :oxen :land :ln-fallow})
+  (into {} (map (juxt :key :amount)) cm/table))
 
 (def health-keys
-  {:slaves :sl-health :horses :hs-health :oxen :ox-health})
+  (into {} (keep (fn [{:keys [key health]}] (when health [key health]))) cm/table))
 
 (def crop-keys
   {:ln-sewn :wt-sewn :ln-grown :wt-grown :ln-ripe :wt-ripe})
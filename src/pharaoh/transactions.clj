@@ -0,0 +1,143 @@
+(ns pharaoh.transactions
+  (:require [pharaoh.loans :as ln]
+            [pharaoh.messages :as msg]
+            [pharaoh.overseers :as ov]
+            [pharaoh.trading :as tr]))
+
+;; The settlement rules of BuySell, DoLoan and DoOverseer, without the
+;; dialogs. An order is a map such as
+;;   {:op :buy :commodity :oxen :amount 20}
+;; :op is :buy, :sell or :keep (with a :commodity), :borrow or :repay,
+;; :hire, :fire or :obtain, or one of the standing orders :feed (with a
+;; :commodity), :plant, :spread and :quota. A :borrow past the credit
+;; limit needs :credit-check true to go to the banker, as the dialog's
+;; second question does.
+;;
+;; Each order gives a result {:status :ok|:capped|:error ...}. :capped
+;; went through for less than was asked and :amount says how much; an
+;; :error leaves the state as it was and carries a :reason, plus the
+;; :max-amount or :fee the dialog would quote. A refused, capped or
+;; credit-checked order also carries the :message the dialog answers
+;; with, picked here, so orders draw from the rng exactly as the dialogs
+;; do and a batch replays the game typed in. Input a dialog turns away
+;; before it is an order (no amount, no mode chosen) has no order.
+
+(def ^:private commodity-ops #{:buy :sell :keep})
+
+(def ^:private feed-keys
+  {:slaves :sl-feed-rt :oxen :ox-feed-rt :horses :hs-feed-rt})
+
+(def ^:private rate-keys
+  {:plant :ln-to-sew :spread :mn-to-sprd :quota :py-quota})
+
+(def ops
+  (into #{:borrow :repay :hire :fire :obtain :feed}
+        (concat commodity-ops (keys rate-keys))))
+
+(defn- ok [state amount]
+  {:state state :result {:status :ok :amount amount}})
+
+(defn- err [state reason & {:as more}]
+  {:state state :result (merge {:status :error :reason reason} more)})
+
+(defn- say [rng pool & args]
+  (apply format (msg/pick rng pool) args))
+
+;; nil for a well-formed order, else the reason it is not.
+(defn check-order [{:keys [op commodity amount]}]
+  (cond
+    (not (ops op)) :unknown-op
+    (not (and (number? amount) (>= amount 0))) :invalid-amount
+    (and (commodity-ops op) (not (tr/commodity-keys commodity))) :unknown-commodity
+    (and (= :feed op) (not (feed-keys commodity))) :unknown-commodity))
+
+(defn- buy [rng state commodity amt]
+  (let [v (tr/validate-buy state commodity amt)]
+    (if (= :error (:status v))
+      (err state :insufficient-funds :max-amount (:max-amount v)
+           :message (say rng msg/insufficient-funds-messages (:max-amount v)))
+      (let [supply (get-in state [:supply commodity] 0.0)
+            actual (min amt (max supply 1.0))
+            state (tr/buy rng state commodity amt)]
+        (if (< actual amt)
+          {:state state
+           :result {:status :capped :reason :demand-limit :amount actual
+                    :message (say rng msg/demand-limit-messages actual)}}
+          (ok state amt))))))
+
+(defn- sell [rng state commodity amt]
+  (let [v (tr/validate-sell state commodity amt)]
+    (case (:status v)
+      :error (err state :not-owned :max-amount (:max-amount v)
+                  :message (say rng msg/selling-more-messages (:max-amount v)))
+      :capped (err state :supply-limit :max-amount (:max-amount v)
+                   :message (say rng msg/supply-limit-messages (:max-amount v)))
+      (ok (tr/sell rng state commodity amt) amt))))
+
+(defn- keep-at [rng state commodity amt]
+  (let [delta (- amt (get state commodity 0.0))]
+    (cond
+      (pos? delta) (ok (tr/buy rng state commodity delta) delta)
+      (neg? delta) (ok (tr/sell rng state commodity (- delta)) delta)
+      :else (ok state 0.0))))
+
+;; C: the banker's answer once the player pays for a credit check.
+;; The fee is financed into the loan when it is approved.
+(defn credit-checked-loan [rng state amt fee]
+  (let [total (+ amt fee)
+        checked (ln/credit-check rng state)]
+    (if (<= (+ (:loan checked) total) (:credit-limit checked))
+      (let [s (-> checked (update :loan + total) (update :gold + total))]
+        (assoc-in (ok s total) [:result :message]
+                  (say rng msg/loan-approval-messages total
+                       (+ (:interest s) (:int-addition s)))))
+      (err (update state :gold #(max 0.0 (- % fee)))
+           :credit-denied :fee fee :message (msg/pick rng msg/loan-denial-messages)))))
+
+;; The dialog asks about the credit check before the banker answers.
+(defn- borrow [rng state amt credit-check?]
+  (let [result (ln/borrow rng state amt)]
+    (if-not (:needs-credit-check result)
+      (ok result amt)
+      (let [fee (:fee result)
+            m (say rng msg/credit-check-messages fee)]
+        (if credit-check?
+          (credit-checked-loan rng state amt fee)
+          (err state :needs-credit-check :fee fee :message m))))))
+
+(defn- or-error [state reason result amount]
+  (if (:error result)
+    (err state reason :text (:error result))
+    (ok result amount)))
+
+(defn- settle [rng state {:keys [op commodity amount credit-check]}]
+  (case op
+    :buy (buy rng state commodity amount)
+    :sell (sell rng state commodity amount)
+    :keep (keep-at rng state commodity amount)
+    :borrow (borrow rng state amount credit-check)
+    :repay (or-error state :insufficient-gold (ln/repay state amount) amount)
+    :hire (ok (ov/hire state (long amount)) (long amount))
+    :fire (or-error state :too-many (ov/fire state (long amount)) (long amount))
+    :obtain (ok (ov/obtain state (long amount)) (long amount))
+    :feed (ok (assoc state (feed-keys commodity) amount) amount)
+    (ok (assoc state (rate-keys op) amount) amount)))
+
+;; Returns {:state :result}.
+(defn apply-order [rng state order]
+  (if-let [reason (check-order order)]
+    (err state reason)
+    (settle rng state order)))
+
+;; Orders are checked in one pass before any is applied; a malformed
+;; order is reported and skipped, the rest go through in order.
+(defn apply-orders [rng state orders]
+  (let [orders (vec orders)
+        checks (mapv check-order orders)]
+    (loop [state state results (transient []) i 0]
+      (if (= i (count orders))
+        {:state state :results (persistent! results)}
+        (if-let [reason (checks i)]
+          (recur state (conj! results {:status :error :reason reason}) (inc i))
+          (let [{s :state r :result} (settle rng state (nth orders i))]
+            (recur s (conj! results r) (inc i))))))))
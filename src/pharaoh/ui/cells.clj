@@ -0,0 +1,32 @@
+(ns pharaoh.ui.cells)
+
+;; Retained cell model for the main screen. PrintScreen re-ran FmtFloat
+;; for every cell on every update. Here each cell keeps the value it last
+;; saw and the text made from it: a cell is re-formatted only when its
+;; value changes, and reported dirty only when its text changes.
+;;
+;; A spec is {:cell [col row] :read (fn [state] value) :fmt (fn [value] text)}.
+
+(def empty-model {:raw {} :text {}})
+
+(defn- seen? [model cell raw]
+  (and (contains? (:raw model) cell)
+       (= raw (get-in model [:raw cell]))))
+
+(defn refresh [model specs state]
+  (reduce (fn [{:keys [model dirty] :as acc} {:keys [cell read fmt]}]
+            (let [raw (read state)]
+              (if (seen? model cell raw)
+                acc
+                (let [text (fmt raw)]
+                  {:model (-> model
+                              (assoc-in [:raw cell] raw)
+                              (assoc-in [:text cell] text))
+                   :dirty (if (= text (get-in model [:text cell]))
+                            dirty
+                            (conj dirty cell))}))))
+          {:model model :dirty #{}}
+          specs))
+
+(defn text [model cell]
+  (get-in model [:text cell]))
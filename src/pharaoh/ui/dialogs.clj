@@ -1,12 +1,9 @@
 (ns pharaoh.ui.dialogs
   (:require [clojure.string :as str]
             [pharaoh.contracts :as ct]
-            [pharaoh.loans :as ln]
             [pharaoh.messages :as msg]
-            [pharaoh.overseers :as ov]
             [pharaoh.persistence :as ps]
-            [pharaoh.trading :as tr]
-            [pharaoh.random :as r]))
+            [pharaoh.transactions :as tx]))
 
 ;; Dialog state is stored in the app state atom
 ;; :dialog - nil or {:type :buy-sell/:loan/:feed/:plant/:overseer/:pyramid
@@ -78,29 +75,13 @@
   (assoc-in state [:dialog :mode] mode))
 
 (defn accept-credit-check [rng state]
-  (let [d (:dialog state)
-        fee (:fee d)
-        amt (:borrow-amt d)
-        total-amt (+ amt fee)
-        old-limit (:credit-limit state)
-        state (ln/credit-check rng state)
-        new-limit (:credit-limit state)]
-    (if (<= (+ (:loan state) total-amt) new-limit)
-      ;; C code: loan += amt; gold += amt (fee financed into loan)
-      (let [int-rate (+ (:interest state) (:int-addition state))
-            m (format (msg/pick rng msg/loan-approval-messages) total-amt int-rate)]
-        (-> state
-            (update :loan + total-amt)
-            (update :gold + total-amt)
-            (dissoc :dialog)
-            (assoc :message {:text m :face (:banker state)})))
-      ;; C code: creditLimit = oldCreditLimit; gold = max(0, gold-cost)
-      (let [m (msg/pick rng msg/loan-denial-messages)]
-        (-> state
-            (assoc :credit-limit old-limit)
-            (update :gold #(max 0.0 (- % fee)))
-            (dissoc :dialog)
-            (assoc :message {:text m :face (:banker state)}))))))
+  (let [{:keys [fee borrow-amt]} (:dialog state)
+        {s :state r :result} (tx/credit-checked-loan rng state borrow-amt fee)]
+    ;; C code: approved, loan += amt; gold += amt (fee financed into
+    ;; loan); denied, creditLimit = oldCreditLimit; gold = max(0, gold-cost)
+    (-> s
+        (dissoc :dialog)
+        (assoc :message {:text (:message r) :face (:banker state)}))))
 
 (defn reject-credit-check [state]
   (assoc state :dialog
@@ -167,89 +148,50 @@
         (assoc state :message (pick-error rng (error-category (:type d))))
         (case (:type d)
           :buy-sell
-          (let [commodity (:commodity d)]
-            (case (:mode d)
-              :buy (let [v (tr/validate-buy state commodity amt)]
-                     (if (= :error (:status v))
-                       (assoc state :message
-                              (format (msg/pick rng msg/insufficient-funds-messages)
-                                      (:max-amount v)))
-                       (let [supply (get-in state [:supply commodity] 0.0)
-                             actual (min amt (max supply 1.0))
-                             result (tr/buy rng state commodity amt)]
-                         (if (< actual amt)
-                           (assoc (close-dialog result) :message
-                                  (format (msg/pick rng msg/demand-limit-messages)
-                                          actual))
-                           (close-dialog result)))))
-              :sell (let [v (tr/validate-sell state commodity amt)]
-                      (case (:status v)
-                        :error
-                        (assoc state :message
-                               (format (msg/pick rng msg/selling-more-messages)
-                                       (:max-amount v)))
-                        :capped
-                        (assoc state :message
-                               (format (msg/pick rng msg/supply-limit-messages)
-                                       (:max-amount v)))
-                        (close-dialog (tr/sell rng state commodity amt))))
-              :keep (let [current (get state commodity 0.0)
-                          delta (- amt current)]
-                      (cond
-                        (pos? delta) (close-dialog (tr/buy rng state commodity delta))
-                        (neg? delta) (close-dialog (tr/sell rng state commodity (- delta)))
-                        :else (close-dialog state)))
+          (let [{s :state r :result}
+                (tx/apply-order rng state {:op (:mode d) :commodity (:commodity d)
+                                           :amount amt})]
+            (case [(:status r) (:reason r)]
+              ([:error :insufficient-funds] [:error :not-owned] [:error :supply-limit])
+              (assoc state :message (:message r))
+              [:capped :demand-limit]
+              (assoc (close-dialog s) :message (:message r))
+              [:error :unknown-op]
               (assoc state :message
-                     (pick-error rng :buysell-no-function))))
+                     (pick-error rng :buysell-no-function))
+              (close-dialog s)))
 
           :loan
-          (case (:mode d)
-            :borrow (let [result (ln/borrow rng state amt)]
-                      (cond
-                        (:needs-credit-check result)
-                        (let [fee (:fee result)
-                              m (format (msg/pick rng msg/credit-check-messages) fee)]
-                          (assoc state :dialog
-                                 (assoc d :mode :credit-check
-                                          :fee fee :borrow-amt amt
-                                          :message m)))
-                        (:error result)
-                        (assoc state :message (:error result))
-                        :else
-                        (close-dialog result)))
-            :repay (let [result (ln/repay state amt)]
-                     (if (:error result)
-                       (assoc state :message (:error result))
-                       (close-dialog result)))
+          (if-not (#{:borrow :repay} (:mode d))
             (assoc state :message
-                   (pick-error rng :loan-no-function)))
-
-          :feed
-          (let [k (case (:commodity d)
-                    :slaves :sl-feed-rt
-                    :oxen :ox-feed-rt
-                    :horses :hs-feed-rt)]
-            (close-dialog (assoc state k amt)))
-
-          :plant
-          (close-dialog (assoc state :ln-to-sew amt))
-
-          :spread
-          (close-dialog (assoc state :mn-to-sprd amt))
-
-          :pyramid
-          (close-dialog (assoc state :py-quota amt))
+                   (pick-error rng :loan-no-function))
+            (let [{s :state r :result}
+                  (tx/apply-order rng state {:op (:mode d) :amount amt})]
+              (case (:reason r)
+                :needs-credit-check
+                (assoc state :dialog
+                       (assoc d :mode :credit-check
+                                :fee (:fee r) :borrow-amt amt
+                                :message (:message r)))
+                :insufficient-gold
+                (assoc state :message (:text r))
+                (close-dialog s))))
+
+          (:feed :plant :spread :pyramid)
+          (let [op (if (= :pyramid (:type d)) :quota (:type d))]
+            (close-dialog (:state (tx/apply-order rng state
+                                                  {:op op :commodity (:commodity d)
+                                                   :amount amt}))))
 
           :overseer
-          (case (:mode d)
-            :hire (close-dialog (ov/hire state (long amt)))
-            :fire (let [result (ov/fire state (long amt))]
-                    (if (:error result)
-                      (assoc state :message (:error result))
-                      (close-dialog result)))
-            :obtain (close-dialog (ov/obtain state (long amt)))
+          (if-not (#{:hire :fire :obtain} (:mode d))
             (assoc state :message
-                   (pick-error rng :overseer-no-function)))
+                   (pick-error rng :overseer-no-function))
+            (let [{s :state r :result}
+                  (tx/apply-order rng state {:op (:mode d) :amount amt})]
+              (if (= :error (:status r))
+                (assoc state :message (:text r))
+                (close-dialog s))))
 
           (close-dialog state)))))
     state))
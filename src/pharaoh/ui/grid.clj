@@ -0,0 +1,132 @@
+(ns pharaoh.ui.grid
+  (:require [clojure.string :as str]
+            [pharaoh.commodities :as cm]
+            [pharaoh.derived :as dv]
+            [pharaoh.state :as st]
+            [pharaoh.ui.layout :as lay]))
+
+;; What the main screen shows, independent of how it is drawn: section
+;; titles, static labels, and the value cells with their readers and
+;; formatters. The Quil screen and the offscreen raster both paint these.
+
+(def month-names
+  ["" "Jan" "Feb" "Mar" "Apr" "May" "Jun"
+   "Jul" "Aug" "Sep" "Oct" "Nov" "Dec"])
+
+(defn fmt [x] (format "%.0f" (double x)))
+(defn fmt1 [x] (format "%.1f" (double x)))
+(defn- fmt-pending [c]
+  (let [months (or (:months-left c) (:duration c))]
+    (format "%s %s %s @ %s gold %smo"
+            (name (:type c)) (fmt (:amount c))
+            (cm/text (:what c)) (fmt (:price c))
+            (str months))))
+
+(defn delta-pct [cur old]
+  (if (and (pos? old) (not= cur old))
+    (format "%+.0f%%" (* 100 (/ (- cur old) old)))
+    ""))
+
+(defn section-title [section]
+  (case section
+    :spread-plant "Spread & Plant"
+    :feed-rates "Feed Rates"
+    (str/capitalize (name section))))
+
+(defn section-line-rows [section]
+  (let [[_ _ _ h] (lay/sections section)]
+    (if (= section :pyramid) 4 h)))
+
+(defn span-rect [{[col row] :cell [cols rows] :span}]
+  (lay/cell-rect-span col row (or cols 1) (or rows 1)))
+
+;; === Cell tables ===
+
+(def ^:private commodity-rows
+  [[1 "Wheat (w)" :wheat :old-wheat]
+   [2 "Manure (m)" :manure :old-manure]
+   [3 "Slaves (s)" :slaves :old-slaves]
+   [4 "Horses (h)" :horses :old-horses]
+   [5 "Oxen (o)" :oxen :old-oxen]])
+
+(def labels
+  (concat
+    (map (fn [[row label]] [0 row label]) commodity-rows)
+    [[0 6 "Land (l)"]
+     [4 1 "Wheat"] [4 2 "Manure"] [4 3 "Slaves"]
+     [4 4 "Horses"] [4 5 "Oxen"] [4 6 "Land"]
+     [6 1 "Slaves (S)"] [6 2 "Oxen (O)"] [6 3 "Horses (H)"]
+     [8 1 "Year"] [8 2 "Month"]
+     [6 5 "O'seers (g)"] [6 6 "Salary"] [6 7 "Press"]
+     [8 4 "Loan (L)"] [8 5 "Int%"] [8 6 "Credit"] [8 7 "Rating"]
+     [0 9 "Fallow"] [1 9 "Planted"] [2 9 "Growing"] [3 9 "Ripe"] [4 9 "Total"]
+     [5 9 "Manure (f)"] [6 9 "Land (p)"]
+     [7 9 "Gold"] [7 10 "NetWth"]
+     [0 12 "Quota (q)"] [1 12 "Stones"] [1 14 "Height"]]))
+
+(defn- val-cell [col row f read]
+  {:cell [col row] :draw :val :read read :fmt f})
+
+(defn- delta-cell [col row k old-k]
+  {:cell [col row] :draw :delta :read (juxt k old-k)
+   :fmt (fn [[cur old]] (delta-pct cur old))})
+
+(defn- price [k] #(get-in % [:prices k]))
+
+(defn- status-text [[year month months-left]]
+  (str "Yr " year " " (month-names month)
+       (when months-left (str "  running, " months-left " to go"))))
+
+(def value-cells
+  (vec
+    (concat
+      (mapcat (fn [[row _ k old-k]]
+                [(val-cell 1 row fmt k)
+                 (delta-cell 2 row k old-k)
+                 (val-cell 3 row fmt old-k)])
+              commodity-rows)
+      [(val-cell 1 6 fmt st/total-land)
+       (val-cell 5 1 fmt1 (price :wheat))
+       (val-cell 5 2 fmt1 (price :manure))
+       (val-cell 5 3 fmt (price :slaves))
+       (val-cell 5 4 fmt (price :horses))
+       (val-cell 5 5 fmt (price :oxen))
+       (val-cell 5 6 fmt (price :land))
+       (val-cell 7 1 fmt1 :sl-feed-rt)
+       (val-cell 7 2 fmt1 :ox-feed-rt)
+       (val-cell 7 3 fmt1 :hs-feed-rt)
+       (val-cell 9 1 str :year)
+       (val-cell 9 2 month-names :month)
+       (val-cell 7 5 fmt :overseers)
+       (val-cell 7 6 fmt :ov-pay)
+       (val-cell 7 7 fmt1 :ov-press)
+       (val-cell 9 4 fmt :loan)
+       (val-cell 9 5 fmt1 #(+ (:interest %) (:int-addition %)))
+       (val-cell 9 6 fmt :credit-limit)
+       (val-cell 9 7 fmt1 :credit-rating)
+       (val-cell 0 10 fmt :ln-fallow)
+       (val-cell 1 10 fmt :ln-sewn)
+       (val-cell 2 10 fmt :ln-grown)
+       (val-cell 3 10 fmt :ln-ripe)
+       (val-cell 4 10 fmt st/total-land)
+       (val-cell 5 10 fmt :mn-to-sprd)
+       (val-cell 6 10 fmt :ln-to-sew)
+       (val-cell 8 9 fmt :gold)
+       (delta-cell 9 9 :gold :old-gold)
+       (val-cell 8 10 fmt #(dv/value % :net-worth))
+       (val-cell 0 13 fmt :py-quota)
+       (val-cell 1 13 fmt :py-stones)
+       (val-cell 2 14 fmt1 :py-height)
+       {:cell [0 15] :span [3 8] :draw :pyramid
+        :read (juxt :py-base :py-stones) :fmt identity}]
+      (for [i (range 10)]
+        {:cell [3 (+ 12 i)] :span [7 1] :draw :label
+         :read #(get (:cont-pend %) i)
+         :fmt #(if % (fmt-pending %) "")})
+      [{:cell [0 23] :span [2 1] :draw :quit-button
+        :read #(= :quit (:hover-btn %)) :fmt identity}
+       {:cell [8 23] :span [2 1] :draw :run-button
+        :read #(= :run (:hover-btn %)) :fmt identity}
+       {:cell [3 23] :span [4 1] :draw :status
+        :read (juxt :year :month #(get-in % [:autorun :months-left]))
+        :fmt status-text}])))
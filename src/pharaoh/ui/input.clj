@@ -1,7 +1,9 @@
 (ns pharaoh.ui.input
-  (:require [pharaoh.ui.layout :as lay]
+  (:require [pharaoh.autorun :as ar]
+            [pharaoh.ui.layout :as lay]
             [pharaoh.ui.dialogs :as dlg]
             [pharaoh.ui.file-actions :as fa]
+            [pharaoh.notices :as nt]
             [pharaoh.simulation :as sim]
             [pharaoh.random :as r]))
 
@@ -41,6 +43,8 @@
 
 (def esc-char (char 27))
 
+(def year-run {:months 12 :cash-below 0.0 :contract-due true})
+
 (defn- dialog-mode-for [dtype key-char]
   (case key-char
     \b (case dtype :buy-sell :buy :loan :borrow nil)
@@ -128,16 +132,28 @@
       (:save-file :load-file) (handle-file-dialog-key rng state key-char)
       (handle-generic-dialog-key rng state key-char))))
 
+;; Which simulation run, if any, a key starts in the current state. The
+;; game hands these to the engine thread rather than running them here.
+(defn run-request [state key-char]
+  (when-not (or (:autorun state) (:dialog state) (:message state)
+                (get key-actions key-char))
+    (case key-char
+      (\r \R) :run
+      \y :autorun
+      nil)))
+
 (defn handle-key [rng state key-char & [key-kw]]
   (cond
+    (:autorun state)
+    (ar/cancel state)
+
     (:dialog state)
     (handle-dialog-key rng state key-char key-kw)
 
     (map? (:message state))
     (let [state (dissoc state :message)
           state (if (seq (:contract-msgs state))
-                  (let [[msg & rest] (:contract-msgs state)]
-                    (assoc state :message msg :contract-msgs (vec rest)))
+                  (nt/pop-next state)
                   state)]
       (cond-> (assoc state :reset-visit-timers true)
         (:game-over state) (assoc :quit-clicked true)))
@@ -151,6 +167,7 @@
       (case key-char
         \r (sim/do-run rng state)
         \R (sim/do-run rng state)
+        \y (ar/start state year-run)
         (dissoc state :message)))))
 
 (defn- in-section? [col row sec-key]
@@ -0,0 +1,128 @@
+(ns pharaoh.ui.raster
+  (:require [pharaoh.pyramid :as py]
+            [pharaoh.ui.cells :as cells]
+            [pharaoh.ui.grid :as grid]
+            [pharaoh.ui.layout :as lay])
+  (:import [java.awt Color Font Graphics2D]
+           [java.awt.image BufferedImage DataBufferInt]))
+
+;; Software backend for the main screen. It paints the same grid as
+;; pharaoh.ui.screen into a BufferedImage, with no window or display, so
+;; it runs on a headless JVM. Like the screen it keeps a cell model:
+;; after the first frame only cells whose text changed are repainted.
+
+(defn- color
+  ([v] (color v v v))
+  ([r g b] (Color. (int r) (int g) (int b))))
+
+(def ^:private white (color 255))
+(def ^:private black (color 0))
+
+(defn- font [size] (Font. "Monospaced" Font/PLAIN (int size)))
+
+(def ^:private fonts
+  {:title (font lay/title-size) :label (font lay/label-size)
+   :value (font lay/value-size) :small (font lay/small-size)})
+
+(defn- text! [^Graphics2D g c f s x y]
+  (.setColor g c)
+  (.setFont g (fonts f))
+  (.drawString g (str s) (float x) (float y)))
+
+(defn- box! [^Graphics2D g fill stroke x y w h arc]
+  (let [[x y w h arc] (map int [x y w h (* 2 arc)])]
+    (when fill
+      (.setColor g fill)
+      (.fillRoundRect g x y w h arc arc))
+    (when stroke
+      (.setColor g stroke)
+      (.drawRoundRect g x y w h arc arc))))
+
+(defn- triangle! [^Graphics2D g fill stroke [x1 y1 x2 y2 x3 y3]]
+  (let [xs (int-array (map int [x1 x2 x3]))
+        ys (int-array (map int [y1 y2 y3]))]
+    (when fill
+      (.setColor g fill)
+      (.fillPolygon g xs ys 3))
+    (.setColor g stroke)
+    (.drawPolygon g xs ys 3)))
+
+(defn- draw-static [^Graphics2D g]
+  (.setColor g white)
+  (.fillRect g 0 0 (int lay/win-w) (int lay/win-h))
+  (doseq [[section [c r cols rows]] lay/sections]
+    (let [{:keys [x y w h]} (lay/cell-rect-span c r cols rows)]
+      (box! g nil (color 160) x y w h 0)
+      (.setColor g (color 210))
+      (doseq [i (range 1 (grid/section-line-rows section))]
+        (let [ly (int (+ y (* i lay/cell-h)))]
+          (.drawLine g (int x) ly (int (+ x w)) ly)))
+      (text! g (color 60) :title (grid/section-title section)
+             (+ x 4) (+ y lay/title-size 2))))
+  (doseq [[col row label] grid/labels]
+    (let [{:keys [x y]} (lay/cell-rect col row)]
+      (text! g (color 80) :label label (+ x 3) (+ y lay/label-size 2))))
+  (let [{:keys [x y w h]} (lay/cell-rect-span 8 11 1 1)]
+    (box! g (color 180 200 255) (color 100 120 180) x y w h 3)
+    (text! g black :label "Offers(c)" (+ x 3) (+ y lay/label-size 2))))
+
+(defn- draw-pyramid [g {:keys [x y w h]} [base stones]]
+  (let [max-h (py/py-max base)
+        pct (if (pos? max-h) (/ (py/py-height base stones) max-h) 0)
+        tri-h (* h pct)
+        mid (+ x (/ w 2.0))
+        half-base (* (/ w 2.0) pct)]
+    (triangle! g nil (color 210) [mid y x (+ y h) (+ x w) (+ y h)])
+    (triangle! g (color 180 150 80) (color 120 100 50)
+               [mid (- (+ y h) tri-h)
+                (- mid half-base) (+ y h)
+                (+ mid half-base) (+ y h)])))
+
+(defn- draw-button [g {:keys [x y w h]} label hover? dx [fill hfill stroke hstroke]]
+  (box! g (apply color (if hover? hfill fill)) (apply color (if hover? hstroke stroke))
+        x y w h 5)
+  (text! g black :title label (+ x dx) (+ y lay/title-size 4)))
+
+(defn- draw-cell [g {kind :draw :as spec} text]
+  (let [{:keys [x y w] :as r} (grid/span-rect spec)
+        s (str text)]
+    (case kind
+      :val (text! g black :value s (+ x 3) (+ y lay/value-size 2))
+      :delta (when (seq s)
+               (text! g (if (.startsWith s "+") (color 0 120 0) (color 180 0 0))
+                      :small s (+ x 3) (+ y lay/small-size 2)))
+      :label (text! g (color 80) :label s (+ x 3) (+ y lay/label-size 2))
+      :pyramid (draw-pyramid g r text)
+      :quit-button (draw-button g r "QUIT" text (/ w 4)
+                                [[200] [230 180 180] [160] [180]])
+      :run-button (draw-button g r "RUN (r)" text (/ w 6)
+                               [[100 180 100] [130 220 130]
+                                [80 140 80] [100 180 100]])
+      :status (text! g (color 100) :small s (+ x 4) (+ y lay/small-size 4)))))
+
+(defn- clear-cell [^Graphics2D g spec]
+  (let [{:keys [x y w h]} (grid/span-rect spec)]
+    (.setColor g white)
+    (.fillRect g (int (inc x)) (int (inc y)) (int (- w 2)) (int (- h 2)))))
+
+(defn make-canvas []
+  (let [image (BufferedImage. (int lay/win-w) (int lay/win-h)
+                              BufferedImage/TYPE_INT_RGB)]
+    {:image image :g (.createGraphics image)
+     :model cells/empty-model :fresh? true}))
+
+(defn render [{:keys [g model fresh?] :as canvas} state]
+  (let [{:keys [model dirty]} (cells/refresh model grid/value-cells state)]
+    (when fresh? (draw-static g))
+    (doseq [spec grid/value-cells
+            :when (or fresh? (dirty (:cell spec)))]
+      (when-not fresh? (clear-cell g spec))
+      (draw-cell g spec (cells/text model (:cell spec))))
+    (assoc canvas :model model :fresh? false)))
+
+(defn width [canvas] (.getWidth ^BufferedImage (:image canvas)))
+(defn height [canvas] (.getHeight ^BufferedImage (:image canvas)))
+
+;; The framebuffer itself: one packed 0xRRGGBB int per pixel, row-major.
+(defn pixels ^ints [canvas]
+  (.getData ^DataBufferInt (.getDataBuffer (.getRaster ^BufferedImage (:image canvas)))))
@@ -1,26 +1,9 @@
 (ns pharaoh.ui.screen
   (:require [quil.core :as q]
+            [pharaoh.ui.cells :as cells]
+            [pharaoh.ui.grid :as grid]
             [pharaoh.ui.layout :as lay]
-            [pharaoh.ui.pyramid-render :as pyr]
-            [pharaoh.state :as st]))
-
-(def ^:private month-names
-  ["" "Jan" "Feb" "Mar" "Apr" "May" "Jun"
-   "Jul" "Aug" "Sep" "Oct" "Nov" "Dec"])
-
-(defn- fmt [x] (format "%.0f" (double x)))
-(defn- fmt1 [x] (format "%.1f" (double x)))
-(defn- fmt-pending [c]
-  (let [months (or (:months-left c) (:duration c))]
-    (format "%s %s %s @ %s gold %smo"
-            (name (:type c)) (fmt (:amount c))
-            (name (:what c)) (fmt (:price c))
-            (str months))))
-
-(defn- delta-pct [cur old]
-  (if (and (pos? old) (not= cur old))
-    (format "%+.0f%%" (* 100 (/ (- cur old) old)))
-    ""))
+            [pharaoh.ui.pyramid-render :as pyr]))
 
 (defn- draw-section-frame
   ([col row cols rows title] (draw-section-frame col row cols rows title rows))
@@ -69,145 +52,93 @@
     (q/fill 0)
     (q/text (str value) (+ x mid) (+ y lay/label-size 2))))
 
-(defn draw-screen [state]
-  (q/background 255)
-
-  ;; Section frames
-  (doseq [[section [c r w h]] lay/sections]
-    (let [title (case section
-                  :spread-plant "Spread & Plant"
-                  :feed-rates "Feed Rates"
-                  (clojure.string/capitalize (name section)))
-          line-rows (if (= section :pyramid) 4 h)]
-      (draw-section-frame c r w h title line-rows)))
-
-  (let [s state]
-    ;; === Commodities (cols 0-3, rows 1-6) ===
-    (draw-label 0 1 "Wheat (w)")   (draw-val 1 1 (fmt (:wheat s)))
-    (draw-delta 2 1 (delta-pct (:wheat s) (:old-wheat s)))
-    (draw-val 3 1 (fmt (:old-wheat s)))
-
-    (draw-label 0 2 "Manure (m)")  (draw-val 1 2 (fmt (:manure s)))
-    (draw-delta 2 2 (delta-pct (:manure s) (:old-manure s)))
-    (draw-val 3 2 (fmt (:old-manure s)))
-
-    (draw-label 0 3 "Slaves (s)")  (draw-val 1 3 (fmt (:slaves s)))
-    (draw-delta 2 3 (delta-pct (:slaves s) (:old-slaves s)))
-    (draw-val 3 3 (fmt (:old-slaves s)))
-
-    (draw-label 0 4 "Horses (h)")  (draw-val 1 4 (fmt (:horses s)))
-    (draw-delta 2 4 (delta-pct (:horses s) (:old-horses s)))
-    (draw-val 3 4 (fmt (:old-horses s)))
-
-    (draw-label 0 5 "Oxen (o)")    (draw-val 1 5 (fmt (:oxen s)))
-    (draw-delta 2 5 (delta-pct (:oxen s) (:old-oxen s)))
-    (draw-val 3 5 (fmt (:old-oxen s)))
-
-    (draw-label 0 6 "Land (l)")    (draw-val 1 6 (fmt (st/total-land s)))
-
-    ;; === Prices (cols 4-5, rows 1-6) ===
-    (draw-label 4 1 "Wheat")  (draw-val 5 1 (fmt1 (get-in s [:prices :wheat])))
-    (draw-label 4 2 "Manure") (draw-val 5 2 (fmt1 (get-in s [:prices :manure])))
-    (draw-label 4 3 "Slaves") (draw-val 5 3 (fmt (get-in s [:prices :slaves])))
-    (draw-label 4 4 "Horses") (draw-val 5 4 (fmt (get-in s [:prices :horses])))
-    (draw-label 4 5 "Oxen")   (draw-val 5 5 (fmt (get-in s [:prices :oxen])))
-    (draw-label 4 6 "Land")   (draw-val 5 6 (fmt (get-in s [:prices :land])))
-
-    ;; === Feed Rates (cols 6-7, rows 1-3) ===
-    (draw-label 6 1 "Slaves (S)") (draw-val 7 1 (fmt1 (:sl-feed-rt s)))
-    (draw-label 6 2 "Oxen (O)")   (draw-val 7 2 (fmt1 (:ox-feed-rt s)))
-    (draw-label 6 3 "Horses (H)") (draw-val 7 3 (fmt1 (:hs-feed-rt s)))
-
-    ;; === Date (cols 8-9, rows 1-2) ===
-    (draw-label 8 1 "Year")  (draw-val 9 1 (str (:year s)))
-    (draw-label 8 2 "Month") (draw-val 9 2 (month-names (:month s)))
+;; === Painting ===
 
-    ;; === Overseers (cols 6-7, rows 5-7) ===
-    (draw-label 6 5 "O'seers (g)") (draw-val 7 5 (fmt (:overseers s)))
-    (draw-label 6 6 "Salary")      (draw-val 7 6 (fmt (:ov-pay s)))
-    (draw-label 6 7 "Press")       (draw-val 7 7 (fmt1 (:ov-press s)))
-
-    ;; === Loan (cols 8-9, rows 4-7) ===
-    (draw-label 8 4 "Loan (L)")  (draw-val 9 4 (fmt (:loan s)))
-    (draw-label 8 5 "Int%")     (draw-val 9 5 (fmt1 (+ (:interest s) (:int-addition s))))
-    (draw-label 8 6 "Credit")   (draw-val 9 6 (fmt (:credit-limit s)))
-    (draw-label 8 7 "Rating")   (draw-val 9 7 (fmt1 (:credit-rating s)))
-
-    ;; === Land (cols 0-4, rows 9-10) ===
-    (draw-label 0 9 "Fallow")  (draw-val 0 10 (fmt (:ln-fallow s)))
-    (draw-label 1 9 "Planted") (draw-val 1 10 (fmt (:ln-sewn s)))
-    (draw-label 2 9 "Growing") (draw-val 2 10 (fmt (:ln-grown s)))
-    (draw-label 3 9 "Ripe")    (draw-val 3 10 (fmt (:ln-ripe s)))
-    (draw-label 4 9 "Total")   (draw-val 4 10 (fmt (st/total-land s)))
-
-    ;; === Spread & Plant (cols 5-6, rows 9-10) ===
-    (draw-label 5 9 "Manure (f)") (draw-val 5 10 (fmt (:mn-to-sprd s)))
-    (draw-label 6 9 "Land (p)")   (draw-val 6 10 (fmt (:ln-to-sew s)))
-
-    ;; === Gold (cols 7-9, rows 9-10) ===
-    (draw-label 7 9 "Gold")    (draw-val 8 9 (fmt (:gold s)))
-    (draw-delta 9 9 (delta-pct (:gold s) (:old-gold s)))
-    (draw-label 7 10 "NetWth") (draw-val 8 10 (fmt (get s :net-worth 0)))
-
-    ;; === Pyramid (cols 0-2, rows 12-23) ===
-    (draw-label 0 12 "Quota (q)")  (draw-label 1 12 "Stones")
-    (draw-val   0 13 (fmt (:py-quota s)))
-    (draw-val   1 13 (fmt (:py-stones s)))
-    (draw-label 1 14 "Height") (draw-val 2 14 (fmt1 (:py-height s)))
-    (let [{:keys [x y w h]} (lay/cell-rect-span 0 15 3 8)]
-      (pyr/draw-pyramid x y w h (:py-base s) (:py-stones s)))
-
-    ;; === Contracts (cols 3-9, rows 12-22) ===
-    ;; Offers button (right end of contracts header row)
-    (let [{:keys [x y w h]} (lay/cell-rect-span 8 11 1 1)]
-      (q/fill 180 200 255)
-      (q/stroke 100 120 180)
-      (q/rect x y w h 3)
-      (q/fill 0)
-      (q/text-size lay/label-size)
-      (q/text "Offers(c)" (+ x 3) (+ y lay/label-size 2)))
-
-    (let [pend (:cont-pend s)]
-      (doseq [i (range (min 10 (count pend)))]
-        (let [c (nth pend i)
-              text (fmt-pending c)]
-          (draw-label 3 (+ 12 i) text))))
-
-    ;; === Controls (row 23-24) ===
-    ;; Quit button (cols 0-1)
-    (let [{:keys [x y w h]} (lay/cell-rect-span 0 23 2 1)
-          hover? (= :quit (:hover-btn s))]
-      (if hover? (q/fill 230 180 180) (q/fill 200))
-      (q/stroke (if hover? 180 160))
-      (q/rect x y w h 5)
-      (q/fill 0)
-      (q/text-size lay/title-size)
-      (q/text "QUIT" (+ x (/ w 4)) (+ y lay/title-size 4)))
-
-    ;; Run button (cols 8-9)
-    (let [{:keys [x y w h]} (lay/cell-rect-span 8 23 2 1)
-          hover? (= :run (:hover-btn s))]
-      (if hover? (q/fill 130 220 130) (q/fill 100 180 100))
-      (q/stroke (if hover? 100 80) (if hover? 180 140) (if hover? 100 80))
-      (q/rect x y w h 5)
-      (q/fill 0)
-      (q/text-size lay/title-size)
-      (q/text "RUN (r)" (+ x (/ w 6)) (+ y lay/title-size 4)))
-
-    ;; Status
-    (let [{:keys [x y w]} (lay/cell-rect-span 3 23 4 1)]
-      (q/fill 100)
-      (q/text-size lay/small-size)
-      (q/text (str "Yr " (:year s) " " (month-names (:month s)))
-              (+ x 4) (+ y lay/small-size 4)))
+(defn- draw-offers-button []
+  (let [{:keys [x y w h]} (lay/cell-rect-span 8 11 1 1)]
+    (q/fill 180 200 255)
+    (q/stroke 100 120 180)
+    (q/rect x y w h 3)
+    (q/fill 0)
+    (q/text-size lay/label-size)
+    (q/text "Offers(c)" (+ x 3) (+ y lay/label-size 2))))
 
-    ;; Error bar (row 24) — only when dialog is open (inline error feedback)
-    (when-let [msg (:message s)]
-      (when (and (string? msg) (:dialog s))
-        (let [{:keys [x y w h]} (lay/cell-rect-span 0 24 10 1)]
-          (q/fill 255 255 220)
-          (q/stroke 200)
-          (q/rect x y w h)
-          (q/fill 0)
-          (q/text-size lay/label-size)
-          (q/text msg (+ x 4) (+ y lay/label-size 4)))))))
+(defn- draw-static []
+  (q/background 255)
+  (doseq [[section [c r w h]] lay/sections]
+    (draw-section-frame c r w h (grid/section-title section)
+                        (grid/section-line-rows section)))
+  (doseq [[col row label] grid/labels]
+    (draw-label col row label))
+  (draw-offers-button))
+
+(defn- draw-button [{:keys [x y w h]} label hover? text-dx [fill hfill stroke hstroke]]
+  (if hover? (apply q/fill hfill) (apply q/fill fill))
+  (if hover? (apply q/stroke hstroke) (apply q/stroke stroke))
+  (q/rect x y w h 5)
+  (q/fill 0)
+  (q/text-size lay/title-size)
+  (q/text label (+ x text-dx) (+ y lay/title-size 4)))
+
+(defn- clear-cell [spec]
+  (let [{:keys [x y w h]} (grid/span-rect spec)]
+    (q/no-stroke)
+    (q/fill 255)
+    (q/rect (+ x 1) (+ y 1) (- w 2) (- h 2))))
+
+(defn- draw-cell [{[col row] :cell kind :draw :as spec} text]
+  (case kind
+    :val (draw-val col row text)
+    :delta (draw-delta col row text)
+    :label (draw-label col row text)
+    :pyramid (let [{:keys [x y w h]} (grid/span-rect spec)
+                   [base stones] text]
+               (pyr/draw-pyramid x y w h base stones))
+    :quit-button (let [r (grid/span-rect spec)]
+                   (draw-button r "QUIT" text (/ (:w r) 4)
+                                [[200] [230 180 180] [160] [180]]))
+    :run-button (let [r (grid/span-rect spec)]
+                  (draw-button r "RUN (r)" text (/ (:w r) 6)
+                               [[100 180 100] [130 220 130]
+                                [80 140 80] [100 180 100]]))
+    :status (let [{:keys [x y]} (grid/span-rect spec)]
+              (q/fill 100)
+              (q/text-size lay/small-size)
+              (q/text text (+ x 4) (+ y lay/small-size 4)))))
+
+;; Error bar (row 24) — only when dialog is open (inline error feedback)
+(defn- draw-error-bar [s]
+  (when-let [msg (:message s)]
+    (when (and (string? msg) (:dialog s))
+      (let [{:keys [x y w h]} (lay/cell-rect-span 0 24 10 1)]
+        (q/fill 255 255 220)
+        (q/stroke 200)
+        (q/rect x y w h)
+        (q/fill 0)
+        (q/text-size lay/label-size)
+        (q/text msg (+ x 4) (+ y lay/label-size 4))))))
+
+;; The canvas is retained between frames. While nothing is drawn over the
+;; grid, only cells whose text changed are cleared and repainted; while a
+;; dialog, message or menu covers it, and on the frame after, the whole
+;; screen is drawn.
+(def ^:private retained (atom {:model cells/empty-model :covered? true}))
+
+(defn invalidate! []
+  (swap! retained assoc :covered? true))
+
+(defn draw-screen
+  ([state] (draw-screen state true))
+  ([state covered?]
+   (let [{:keys [model] :as was} @retained
+         {:keys [model dirty]} (cells/refresh model grid/value-cells state)]
+     (if (or covered? (:covered? was))
+       (do (draw-static)
+           (doseq [spec grid/value-cells]
+             (draw-cell spec (cells/text model (:cell spec)))))
+       (doseq [spec grid/value-cells
+               :when (dirty (:cell spec))]
+         (clear-cell spec)
+         (draw-cell spec (cells/text model (:cell spec)))))
+     (draw-error-bar state)
+     (reset! retained {:model model :covered? covered?}))))
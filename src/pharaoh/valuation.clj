@@ -0,0 +1,88 @@
+(ns pharaoh.valuation
+  (:require [pharaoh.contracts :as ct]
+            [pharaoh.random :as r]))
+
+;; Monte Carlo value of each contract offer, from the player's side.
+;; Each path draws what ContProg would: the month the counterparty
+;; defaults (default-k each month), whether it pays or ships in full
+;; (pay-k, ship-k) or only part, and the commodity's price walk to
+;; maturity. A default pays the player 5% of the price; a part
+;; settlement pays 10% of the unsettled price, as in settle-buy and
+;; settle-sell. The price walk drifts by the state's inflation with a
+;; fixed monthly volatility, a stand-in for AdjustProduction's noise.
+;;
+;; Draws are kept per offer, by months from now. NewOffers ages an offer
+;; by a month and drifts its price, and the same draws still describe
+;; it, so only replaced offers are simulated afresh; an aged one is just
+;; re-summed. The cache has its own rng and never touches the game's.
+
+(def paths 400)
+(def ^:private price-vol 0.05)
+
+(defn empty-cache [seed]
+  {:rng (r/make-rng seed) :draws {} :basis {} :values {}})
+
+;; An offer keeps these while NewOffers ages it.
+(defn- lineage [offer]
+  [(:who offer) (:what offer) (:type offer) (:amount offer)])
+
+(defn- draw-paths [rng player months]
+  (vec (repeatedly paths
+                   (fn []
+                     {:default (ct/months-to-default rng (:default-k player))
+                      :full (r/uniform rng 0.0 1.0)
+                      :fraction (r/uniform rng 0.5 0.95)
+                      :shocks (vec (repeatedly months #(r/gaussian rng 0.0 1.0)))}))))
+
+(defn- path-value [offer player unit0 inflation {:keys [default full fraction shocks]}]
+  (let [{:keys [type amount price duration]} offer
+        log-walk (reduce + (map #(+ inflation (* price-vol %)) (take duration shocks)))
+        unit (* unit0 (Math/exp log-walk))]
+    (if (and default (<= default duration))
+      {:value (* 0.05 price) :default true :unit unit}
+      (let [f (if (< full (if (= :buy type) (:pay-k player) (:ship-k player)))
+                1.0 fraction)
+            settled (* f price)
+            goods (* f amount unit)
+            penalty (* 0.1 (- price settled))]
+        {:value (if (= :buy type)
+                  (+ (- settled goods) penalty)
+                  (+ (- goods settled) penalty))
+         :default false :unit unit}))))
+
+(defn- percentile [sorted q]
+  (nth sorted (min (dec (count sorted)) (long (* q (count sorted))))))
+
+(defn- summarize [offer player state draws]
+  (let [unit0 (get-in state [:prices (:what offer)] 0.0)
+        results (map #(path-value offer player unit0 (:inflation state 0.0) %) draws)
+        units (vec (sort (map :unit results)))
+        n (double (count results))]
+    {:ev (/ (reduce + (map :value results)) n)
+     :default-risk (/ (count (filter :default results)) n)
+     :p10 (percentile units 0.1)
+     :p50 (percentile units 0.5)
+     :p90 (percentile units 0.9)}))
+
+(defn- revalue-offer [{:keys [rng draws values basis]} state offer]
+  (let [k (lineage offer)
+        player (get-in state [:players (:who offer)])
+        old (get draws k)
+        fresh? (or (nil? old) (> (:duration offer) (count (:shocks (first old)))))
+        d (if fresh? (draw-paths rng player (:duration offer)) old)
+        b [offer (get-in state [:prices (:what offer)]) (:inflation state)]]
+    [k d b (if (and (not fresh?) (= b (get basis k)))
+             (get values k)
+             (summarize offer player state d))]))
+
+;; Values every active offer in state, keeping draws for offers that
+;; are still on the table and dropping the rest. An offer whose terms
+;; and market price have not moved keeps its last summary.
+(defn revalue [cache state]
+  (let [offers (filter :active (:cont-offers state))
+        results (mapv #(revalue-offer cache state %) offers)
+        by (fn [i] (into {} (map (fn [r] [(r 0) (r i)]) results)))]
+    (assoc cache :draws (by 1) :basis (by 2) :values (by 3))))
+
+(defn value [cache offer]
+  (get-in cache [:values (lineage offer)]))
@@ -0,0 +1,158 @@
+(ns pharaoh.vecenv
+  (:require [pharaoh.contracts :as ct]
+            [pharaoh.random :as r]
+            [pharaoh.shm :as shm]
+            [pharaoh.timelapse :as tl]
+            [pharaoh.transactions :as tx])
+  (:import [java.nio ByteBuffer ByteOrder DoubleBuffer]
+           [java.util.concurrent Callable ExecutorService Executors ThreadFactory]))
+
+;; N games stepped together for reinforcement learning. The caller owns
+;; the buffers: actions, observations, rewards and done flags are flat
+;; DoubleBuffers, one row per game, and step! writes into them in place.
+;; Buffers from direct-buffer are native memory, so a Python trainer
+;; holding them through JPype sees each step as a numpy view with no
+;; copy. Games are split across a fixed pool of threads; each game keeps
+;; its own rng, so results do not depend on the thread count.
+;;
+;; Observation row: the shm/vars values, then ct/max-offers offer slots
+;; and ct/max-pend pending slots of [active type who what amount price
+;; duration]. Action row, NaN meaning no change:
+;;   0-2  feed rates for slaves, oxen, horses
+;;   3-5  acres to plant, manure to spread, pyramid quota
+;;   6-11 trade per ct/commodities: buy if positive, sell if negative
+;;   12   borrow if positive, repay if negative
+;;   13   hire if positive, fire if negative
+;;   14   offer index to accept, negative for none
+;; After the orders each game runs one month. A game that ends is
+;; reported done and restarted on the next seed of its sequence.
+
+(def action-dim 15)
+(def ^:private slot-fields (inc shm/contract-fields))
+(def obs-dim (+ (count shm/vars) (* slot-fields (+ ct/max-offers ct/max-pend))))
+
+(def ^:private rate-orders
+  [[:feed :slaves] [:feed :oxen] [:feed :horses]
+   [:plant nil] [:spread nil] [:quota nil]])
+
+(defn direct-buffer ^DoubleBuffer [n]
+  (-> (ByteBuffer/allocateDirect (* 8 n))
+      (.order (ByteOrder/nativeOrder))
+      (.asDoubleBuffer)))
+
+;; Default reward: pyramid height gained, and -100 for foreclosure.
+(defn pyramid-reward [before after]
+  (- (- (:py-height after) (:py-height before))
+     (if (:game-over after) 100.0 0.0)))
+
+(defn make-env
+  ([n] (make-env n {}))
+  ([n {:keys [threads difficulty reward]
+       :or {threads (.availableProcessors (Runtime/getRuntime))
+            difficulty "Normal" reward pyramid-reward}}]
+   {:n n :difficulty difficulty :reward reward
+    :games (object-array n)
+    :threads (min threads n)
+    :pool (Executors/newFixedThreadPool
+            (int (max 1 (min threads n)))
+            (reify ThreadFactory
+              (newThread [_ r]
+                (doto (Thread. ^Runnable r "pharaoh-vecenv") (.setDaemon true)))))}))
+
+(defn close [env]
+  (.shutdown ^ExecutorService (:pool env)))
+
+(defn- new-game [difficulty seed episode]
+  (let [rng (r/make-rng (+ seed (* episode 1000003)))]
+    {:rng rng :state (tl/new-game rng difficulty) :seed seed :episode episode}))
+
+(defn- put-slots [^DoubleBuffer buf at slots n]
+  (loop [i 0 cs (seq slots)]
+    (when (< i n)
+      (let [base (+ at (* slot-fields i))
+            c (first cs)]
+        (if (:active c)
+          (do (.put buf (int base) 1.0)
+              (loop [j 1 vs (seq (shm/contract-row c))]
+                (when vs
+                  (.put buf (int (+ base j)) (double (first vs)))
+                  (recur (inc j) (next vs)))))
+          (dotimes [j slot-fields] (.put buf (int (+ base j)) 0.0)))
+        (recur (inc i) (next cs))))))
+
+(defn- observe [^DoubleBuffer obs i state]
+  (let [base (* i obs-dim)
+        offers-at (+ base (count shm/vars))]
+    (loop [j 0 vs (seq shm/vars)]
+      (when vs
+        (let [v (get-in state (second (first vs)))]
+          (.put obs (int (+ base j)) (if (number? v) (double v) Double/NaN)))
+        (recur (inc j) (next vs))))
+    (put-slots obs offers-at (:cont-offers state) ct/max-offers)
+    (put-slots obs (+ offers-at (* slot-fields ct/max-offers))
+               (filter :active (:cont-pend state)) ct/max-pend)))
+
+(defn- signed-order [v pos-op neg-op commodity]
+  (cond
+    (or (Double/isNaN v) (zero? v)) nil
+    (pos? v) {:op pos-op :commodity commodity :amount v}
+    :else {:op neg-op :commodity commodity :amount (- v)}))
+
+(defn- decode-orders [^DoubleBuffer actions i]
+  (let [at (fn [k] (.get actions (int (+ (* i action-dim) k))))]
+    (concat
+      (keep-indexed (fn [k [op commodity]]
+                      (let [v (at k)]
+                        (when-not (Double/isNaN v)
+                          {:op op :commodity commodity :amount v})))
+                    rate-orders)
+      (keep-indexed (fn [k commodity] (signed-order (at (+ 6 k)) :buy :sell commodity))
+                    ct/commodities)
+      (keep identity [(signed-order (at 12) :borrow :repay nil)
+                      (signed-order (at 13) :hire :fire nil)]))))
+
+(defn- accept [state ^DoubleBuffer actions i]
+  (let [v (.get actions (int (+ (* i action-dim) 14)))]
+    (if (or (Double/isNaN v) (neg? v))
+      state
+      (let [result (ct/accept-contract state (long v))]
+        (if (or (nil? result) (:error result)) state result)))))
+
+(defn- step-game [{:keys [difficulty reward]} {:keys [rng state seed episode]}
+                  actions i]
+  (let [s (:state (tx/apply-orders rng state (decode-orders actions i)))
+        s (tl/batch-month rng (accept s actions i))
+        done? (boolean (or (:game-over s) (:game-won s)))]
+    {:game (if done?
+             (new-game difficulty seed (inc episode))
+             {:rng rng :state s :seed seed :episode episode})
+     :reward (double (reward state s))
+     :done done?}))
+
+(defn- run-chunks [{:keys [n threads ^ExecutorService pool]} f]
+  (let [size (long (Math/ceil (/ n (double threads))))
+        tasks (for [start (range 0 n size)]
+                ^Callable (fn []
+                            (dotimes [k (min size (- n start))]
+                              (f (+ start k)))))]
+    (doseq [fut (.invokeAll pool ^java.util.Collection (vec tasks))]
+      (.get ^java.util.concurrent.Future fut))))
+
+(defn reset-games! [{:keys [^objects games difficulty] :as env} ^longs seeds ^DoubleBuffer obs]
+  (run-chunks env (fn [i]
+                    (let [g (new-game difficulty (aget seeds i) 0)]
+                      (aset games i g)
+                      (observe obs i (:state g))))))
+
+(defn step! [{:keys [^objects games] :as env} ^DoubleBuffer actions
+             ^DoubleBuffer obs ^DoubleBuffer rewards ^DoubleBuffer dones]
+  (run-chunks env (fn [i]
+                    (let [{:keys [game reward done]}
+                          (step-game env (aget games i) actions i)]
+                      (aset games i game)
+                      (observe obs i (:state game))
+                      (.put rewards (int i) (double reward))
+                      (.put dones (int i) (if done 1.0 0.0))))))
+
+(defn state-of [{:keys [^objects games]} i]
+  (:state (aget games i)))
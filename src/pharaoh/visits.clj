@@ -58,3 +58,11 @@
           (if (get-in app [:state :message])
             app
             (check-dunning app now)))))))
+
+;; Earliest visit deadline, or nil while nothing can fire: a visit waits
+;; behind a message, a dialog or an open menu, and dunning needs a loan.
+(defn next-visit [{:keys [state] :as app} _now]
+  (when-not (or (:message state) (:dialog state) (get-in app [:menu :open?]))
+    (let [deadlines (cond-> [(:next-idle app) (:next-chat app)]
+                      (pos? (:loan state)) (conj (:next-dunning app)))]
+      (apply min deadlines))))
@@ -1,5 +1,6 @@
 (ns pharaoh.workload
-  (:require [pharaoh.random :as r]
+  (:require [pharaoh.model :as m]
+            [pharaoh.random :as r]
             [pharaoh.tables :as t]
             [pharaoh.pyramid :as py]))
 
@@ -24,50 +25,50 @@
     {:req-work (* base (r/abs-gaussian rng 1.0 0.1))
      :avg-py-height (:avg-py-height comps)}))
 
-(defn slave-capacity [rng state]
-  (let [sl-dth-k (* (t/interpolate (:sl-health state) t/slave-death)
-                    (r/abs-gaussian rng 1.0 0.1))
-        sl-brth-k (* (t/interpolate (:sl-health state) t/slave-birth)
-                     (r/abs-gaussian rng 1.0 0.1))
-        wk-able (* (t/interpolate (:sl-health state) t/work-ability)
-                   (r/abs-gaussian rng 1.0 0.1))
-        hs-eff (* (t/interpolate (:hs-health state) t/horse-efficiency)
-                  (r/abs-gaussian rng 1.0 0.1))
-        hs-dth-k (* (t/interpolate (:hs-health state) t/horse-death)
-                    (r/abs-gaussian rng 1.0 0.1))
-        hs-brth-k (* (t/interpolate (:hs-health state) t/horse-birth)
-                     (r/abs-gaussian rng 1.0 0.1))
-        ox-eff (* (t/interpolate (:ox-health state) t/oxen-efficiency)
-                  (r/abs-gaussian rng 1.0 0.1))
-        ox-dth-k (* (t/interpolate (:ox-health state) t/oxen-death)
-                    (r/abs-gaussian rng 1.0 0.1))
-        ox-brth-k (* (t/interpolate (:ox-health state) t/oxen-birth)
-                     (r/abs-gaussian rng 1.0 0.1))
-        ox-sl (if (pos? (:slaves state)) (/ (:oxen state) (:slaves state)) 0)
-        sl-ov (/ (:slaves state) (+ (:overseers state) 1))
-        hs-ov (if (pos? (:overseers state))
-                (/ (:horses state) (:overseers state)) 0)
-        hs-eff-ov (* hs-ov hs-eff)
-        ov-eff (* (t/interpolate hs-eff-ov t/overseer-effectiveness)
-                  (r/abs-gaussian rng 1.0 0.1))
-        ov-eff-sl (if (pos? sl-ov) (/ ov-eff sl-ov) 0)
-        stress-lash (* (t/interpolate (:ov-press state) t/stress-lash)
-                       (r/abs-gaussian rng 1.0 0.1))
-        sl-lash-rt (* stress-lash ov-eff-sl)
-        pos-motive (* (t/interpolate ov-eff-sl t/positive-motive)
-                      (r/abs-gaussian rng 1.0 0.1))
-        neg-motive (t/interpolate sl-lash-rt t/negative-motive)
-        motive (+ pos-motive neg-motive)
-        ox-mult-k (t/interpolate ox-sl t/ox-mult)
-        ox-mult (max (* ox-mult-k ox-eff) 1)
-        max-wk-sl (* motive wk-able ox-mult)]
-    {:sl-dth-k sl-dth-k :sl-brth-k sl-brth-k :wk-able wk-able
-     :hs-eff hs-eff :hs-dth-k hs-dth-k :hs-brth-k hs-brth-k
-     :ox-eff ox-eff :ox-dth-k ox-dth-k :ox-brth-k ox-brth-k
-     :ov-eff ov-eff :ov-eff-sl ov-eff-sl
-     :stress-lash stress-lash :sl-lash-rt sl-lash-rt
-     :pos-motive pos-motive :neg-motive neg-motive :motive motive
-     :ox-mult-k ox-mult-k :ox-mult ox-mult :max-wk-sl max-wk-sl}))
+(def capacity-model
+  {:inputs [:sl-health :hs-health :ox-health :slaves :oxen :horses
+            :overseers :ov-press]
+   :outputs [:sl-dth-k :sl-brth-k :wk-able :hs-eff :hs-dth-k :hs-brth-k
+             :ox-eff :ox-dth-k :ox-brth-k :ov-eff :ov-eff-sl
+             :stress-lash :sl-lash-rt :pos-motive :neg-motive :motive
+             :ox-mult-k :ox-mult :max-wk-sl]
+   :equations
+   '[{:id :sl-dth-k :noise 0.1 :expr (t/interpolate sl-health t/slave-death)}
+     {:id :sl-brth-k :noise 0.1 :expr (t/interpolate sl-health t/slave-birth)}
+     {:id :wk-able :noise 0.1 :expr (t/interpolate sl-health t/work-ability)}
+     {:id :hs-eff :noise 0.1 :expr (t/interpolate hs-health t/horse-efficiency)}
+     {:id :hs-dth-k :noise 0.1 :expr (t/interpolate hs-health t/horse-death)}
+     {:id :hs-brth-k :noise 0.1 :expr (t/interpolate hs-health t/horse-birth)}
+     {:id :ox-eff :noise 0.1 :expr (t/interpolate ox-health t/oxen-efficiency)}
+     {:id :ox-dth-k :noise 0.1 :expr (t/interpolate ox-health t/oxen-death)}
+     {:id :ox-brth-k :noise 0.1 :expr (t/interpolate ox-health t/oxen-birth)}
+     {:id :ox-sl :expr (if (pos? slaves) (/ oxen slaves) 0)}
+     {:id :sl-ov :expr (/ slaves (+ overseers 1))}
+     {:id :hs-ov :expr (if (pos? overseers) (/ horses overseers) 0)}
+     {:id :hs-eff-ov :expr (* hs-ov hs-eff)}
+     {:id :ov-eff :noise 0.1
+      :expr (t/interpolate hs-eff-ov t/overseer-effectiveness)}
+     {:id :ov-eff-sl :expr (if (pos? sl-ov) (/ ov-eff sl-ov) 0)}
+     {:id :stress-lash :noise 0.1 :expr (t/interpolate ov-press t/stress-lash)}
+     {:id :sl-lash-rt :expr (* stress-lash ov-eff-sl)}
+     {:id :pos-motive :noise 0.1
+      :expr (t/interpolate ov-eff-sl t/positive-motive)}
+     {:id :neg-motive :expr (t/interpolate sl-lash-rt t/negative-motive)}
+     {:id :motive :expr (+ pos-motive neg-motive)}
+     {:id :ox-mult-k :expr (t/interpolate ox-sl t/ox-mult)}
+     {:id :ox-mult :expr (max (* ox-mult-k ox-eff) 1)}
+     {:id :max-wk-sl :expr (* motive wk-able ox-mult)}]})
+
+;; C: RunMonth converter block, generated from capacity-model
+(m/defkernel slave-capacity capacity-model)
+
+;; The converters the rest of RunMonth reads. The others (motive, ov-eff,
+;; ...) only fed the C debug panel.
+(def core-outputs
+  [:sl-dth-k :sl-brth-k :hs-dth-k :hs-brth-k :ox-dth-k :ox-brth-k
+   :sl-lash-rt :ox-mult :max-wk-sl])
+
+(m/defkernel slave-capacity-core capacity-model core-outputs)
 
 (defn compute-efficiency [slaves max-wk-sl req-work]
   (if (zero? req-work)
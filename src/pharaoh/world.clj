@@ -0,0 +1,194 @@
+(ns pharaoh.world
+  (:require [pharaoh.commodities :as cm]
+            [pharaoh.contracts :as ct]
+            [pharaoh.economy :as ec]
+            [pharaoh.orderbook :as ob]
+            [pharaoh.random :as r]
+            [pharaoh.timelapse :as tl]
+            [pharaoh.transactions :as tx])
+  (:import [java.util.concurrent Callable ForkJoinPool Future])
+  (:gen-class))
+
+;; Many kingdoms sharing one set of markets. Each kingdom is a full game
+;; with its own rng, run by a policy that turns its state into orders
+;; for pharaoh.transactions. A world month has two halves:
+;;   1. in parallel, every kingdom trades at the shared prices and runs
+;;      its month; its net purchases are read off the supply it drew;
+;;   2. the net trades are summed in kingdom order and the shared market
+;;      is cleared once, with AdjustProduction on the world's own rng.
+;; The sum and the clearing happen on one thread in a fixed order, so a
+;; world replays exactly whatever the pool size or scheduling. Prices a
+;; kingdom's own RunMonth moves are overwritten by the cleared market.
+;;
+;; Foreign traders deal with the kingdoms through one contract book
+;; (pharaoh.orderbook), also on the world's thread after the clearing:
+;; the contracts whose month has come default or settle against their
+;; kingdom, then new offers are posted, each to one kingdom, whose accept
+;; rule takes it or leaves it listed until it is withdrawn. A month
+;; costs the contracts that come round and the offers posted, however
+;; many traders and contracts there are.
+
+(def market-keys [:prices :supply :demand :production :inflation])
+
+;; A plain AI: plant all fallow land, keep a year of grain for the
+;; slaves, and sell manure beyond what it spreads.
+(defn default-policy [state]
+  (let [need (* 12 (:slaves state) (:sl-feed-rt state))
+        short (- need (:wheat state))
+        spare (- (:manure state) (* 3 (:mn-to-sprd state)))]
+    (cond-> [{:op :plant :amount (:ln-fallow state)}]
+      (pos? short) (conj {:op :buy :commodity :wheat :amount short})
+      (pos? spare) (conj {:op :sell :commodity :manure :amount spare}))))
+
+;; Ships goods it holds, buys goods its treasury covers.
+(defn default-accept [state {:keys [type what amount price]}]
+  (if (= :buy type)
+    (>= (get state (cm/amount-key what) 0.0) amount)
+    (>= (:gold state) price)))
+
+(defn scale-market [market n]
+  (reduce (fn [m k] (update m k #(into {} (map (fn [[c v]] [c (* v n)]) %))))
+          market [:supply :demand :production]))
+
+(defn make-world
+  ([n seed] (make-world n seed {}))
+  ([n seed {:keys [difficulty policy accept traders offers]
+             :or {difficulty "Normal" policy default-policy accept default-accept}}]
+   (let [kingdoms (vec (for [i (range n)]
+                         (let [rng (r/make-rng (+ seed 1 i))]
+                           {:id i :rng rng :policy policy :accept accept
+                            :state (tl/new-game rng difficulty)})))
+         s0 (:state (first kingdoms))
+         rng (r/make-rng seed)]
+     {:rng rng
+      :month 0
+      :world-growth (:world-growth s0)
+      :market (scale-market (select-keys s0 market-keys) n)
+      :kingdoms kingdoms
+      :traders (ct/make-players rng (or traders (* ct/max-players n)))
+      :offers (or offers (* 3 n))
+      :book (ob/empty-book)})))
+
+(defn- playing? [state]
+  (not (or (:game-over state) (:game-won state))))
+
+(defn- step-kingdom [{:keys [rng state policy] :as k} market]
+  (if-not (playing? state)
+    {:kingdom k :net {}}
+    (let [state (merge state market)
+          traded (:state (tx/apply-orders rng state (policy state)))
+          net (into {} (map (fn [[c v]] [c (- v (get-in traded [:supply c]))])
+                            (:supply market)))]
+      {:kingdom (assoc k :state (tl/batch-month rng traded)) :net net})))
+
+;; C: AdjustProduction and the price walk of RunMonth, once for the world.
+(defn clear-market [rng market net world-growth]
+  (let [inflation (ec/update-inflation rng (:inflation market))
+        market (reduce (fn [m c] (update-in m [:supply c] #(max 0.0 (- % (get net c 0.0)))))
+                       (cm/update-prices rng market inflation) cm/codes)]
+    (-> (cm/adjust-markets rng market world-growth)
+        (assoc :inflation inflation))))
+
+(defn- update-state [world k f & args]
+  (if (playing? (get-in world [:kingdoms k :state]))
+    (apply update-in world [:kingdoms k :state] f args)
+    world))
+
+;; C: ContProg for the contracts whose month has come. A part-settled
+;; contract comes due again next month, as in ContProg.
+(defn- settle-contracts [rng {:keys [book traders] :as world} now]
+  (let [{:keys [book events]} (ob/step-month book now)]
+    (reduce (fn [w {:keys [kind contract]}]
+              (let [k (:kingdom contract)]
+                (case kind
+                  :withdrawn w
+                  :default (update-state w k update :gold + (* 0.05 (:price contract)))
+                  :due (let [state (get-in w [:kingdoms k :state])]
+                         (if-not (playing? state)
+                           w
+                           (let [r (ct/settle rng state contract (traders (:who contract)))]
+                             (cond-> (assoc-in w [:kingdoms k :state] (:state r))
+                               (:active (:contract r))
+                               (update :book ob/reschedule (:contract r) (inc now)))))))))
+            (assoc world :book book :contract-events events)
+            events)))
+
+;; C: MakeContract, sized from the world's prices and addressed to one
+;; kingdom.
+(defn- make-offer [rng {:keys [market traders kingdoms]}]
+  (let [who (long (r/uniform rng 0.0 (- (count traders) 0.01)))
+        k (long (r/uniform rng 0.0 (- (count kingdoms) 0.01)))
+        what (cm/codes (long (r/uniform rng 0 5.999)))
+        typ (if (< (r/uniform rng 0.0 1.0) 0.5) :buy :sell)
+        unit (get-in market [:prices what])
+        min-amount (/ 200000.0 unit)
+        amount (Math/ceil (max (r/gaussian rng (* 3.0 min-amount) min-amount) min-amount))]
+    {:type typ :who who :kingdom k :what what :amount amount
+     :price (Math/ceil (* amount unit (+ 0.4 (r/exponential rng 0.6))))
+     :duration (long (r/uniform rng 12.0 36.0))
+     :active true}))
+
+(defn- post-offers [rng {:keys [offers traders] :as world} now]
+  (reduce (fn [w _]
+            (let [c (make-offer rng w)
+                  id (get-in w [:book :next-id])
+                  book (ob/add-offer rng (:book w) c now)
+                  {:keys [state accept]} (get-in w [:kingdoms (:kingdom c)])]
+              (cond
+                (identical? book (:book w)) w
+                (and (playing? state) (accept state c))
+                (assoc w :book (ob/accept rng book id now (traders (:who c))))
+                :else (assoc w :book book))))
+          world (range offers)))
+
+(defn- trade-contracts [rng world now]
+  (post-offers rng (settle-contracts rng world now) now))
+
+(defn- run-all [^ForkJoinPool pool f xs]
+  (let [tasks (mapv (fn [x] ^Callable (fn [] (f x))) xs)]
+    (mapv #(.get ^Future %) (.invokeAll pool ^java.util.Collection tasks))))
+
+(defn step
+  ([world] (step world (ForkJoinPool/commonPool)))
+  ([{:keys [rng market world-growth kingdoms] :as world} pool]
+   (let [results (run-all pool #(step-kingdom % market) kingdoms)
+         net (reduce #(merge-with + %1 (:net %2)) {} results)
+         market (clear-market rng market net world-growth)
+         now (inc (:month world))]
+     (trade-contracts rng
+                      (assoc world
+                             :month now
+                             :market market
+                             :net net
+                             :kingdoms (mapv :kingdom results))
+                      now))))
+
+(defn run [world months]
+  (let [pool (ForkJoinPool.)]
+    (try
+      (nth (iterate #(step % pool) world) months)
+      (finally (.shutdown pool)))))
+
+(defn standings [{:keys [kingdoms]}]
+  (->> kingdoms
+       (map (fn [{:keys [id state]}]
+              {:id id :py-height (:py-height state) :gold (:gold state)
+               :net-worth (- (ec/net-worth state) (:loan state))
+               :status (cond (:game-over state) :foreclosed
+                             (:game-won state) :won
+                             :else :playing)}))
+       (sort-by (comp - :py-height))
+       vec))
+
+;; clojure -M -m pharaoh.world KINGDOMS MONTHS [SEED]
+(defn -main [n months & [seed]]
+  (let [world (make-world (Long/parseLong n)
+                          (if seed (Long/parseLong seed) 1))
+        t0 (System/nanoTime)
+        world (run world (Long/parseLong months))
+        secs (/ (- (System/nanoTime) t0) 1e9)]
+    (doseq [{:keys [id py-height net-worth status]} (take 10 (standings world))]
+      (println (format "Kingdom %4d  pyramid %7.1f  worth %14.0f  %s"
+                       id (double py-height) (double net-worth) (name status))))
+    (println (format "%s kingdoms, %s months in %.3f s" n months secs))
+    (shutdown-agents)))
@@ -0,0 +1,77 @@
+(ns pharaoh.autorun-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.autorun :as ar]
+            [pharaoh.contracts :as ct]
+            [pharaoh.random :as r]
+            [pharaoh.state :as st]))
+
+(defn game-state []
+  (let [rng (r/make-rng 1)]
+    (assoc (st/initial-state)
+      :gold 100000.0 :wheat 5000.0 :slaves 50.0
+      :oxen 20.0 :horses 10.0 :manure 1000.0
+      :ln-fallow 100.0 :sl-feed-rt 8.0
+      :ox-feed-rt 60.0 :hs-feed-rt 50.0
+      :ln-to-sew 20.0 :mn-to-sprd 5.0
+      :overseers 3.0 :ov-pay 300.0
+      :py-quota 10.0
+      :players (ct/make-players rng))))
+
+(defn- months-between [a b]
+  (- (+ (* 12 (:year b)) (:month b))
+     (+ (* 12 (:year a)) (:month a))))
+
+(deftest runs-the-requested-number-of-months
+  (let [state (game-state)
+        result (ar/run-frame (r/make-rng 42) (ar/start state {:months 3})
+                             Long/MAX_VALUE)]
+    (is (= 3 (months-between state result)))
+    (is (nil? (:autorun result)))
+    (is (re-find #"Ran 3 months" (:text (:message result))))))
+
+(deftest one-month-per-frame-when-out-of-time
+  (let [state (game-state)
+        result (ar/run-frame (r/make-rng 42) (ar/start state {:months 6}) 0)]
+    (is (= 1 (months-between state result)))
+    (is (= 5 (get-in result [:autorun :months-left])))
+    (is (nil? (:message result)))))
+
+(deftest stops-when-cash-falls-below-threshold
+  (let [state (game-state)
+        result (ar/run-frame (r/make-rng 42)
+                             (ar/start state {:months 12 :cash-below 1e9})
+                             Long/MAX_VALUE)]
+    (is (= 1 (months-between state result)))
+    (is (re-find #"gold fell below" (:text (:message result))))))
+
+(deftest stops-when-a-contract-is-due
+  (let [contract {:type :buy :who 0 :what :wheat :amount 100.0
+                  :price 1000.0 :duration 3 :active true :pct 0.0}
+        state (assoc (game-state) :cont-pend [contract]
+                :players [{:pay-k 1.0 :ship-k 1.0 :default-k 1.0
+                           :name "King HamuNam"}])
+        result (ar/run-frame (r/make-rng 42)
+                             (ar/start state {:months 12 :contract-due true})
+                             Long/MAX_VALUE)]
+    (is (= 2 (months-between state result)))
+    (is (re-find #"contract is due" (:text (:message result))))))
+
+(deftest alerts-are-logged-and-queued-for-review
+  (let [contract {:type :buy :who 0 :what :wheat :amount 100.0
+                  :price 1000.0 :duration 1 :active true :pct 0.0}
+        state (assoc (game-state) :cont-pend [contract]
+                :players [{:pay-k 1.0 :ship-k 1.0 :default-k 1.0
+                           :name "King HamuNam"}])
+        running (ar/step (r/make-rng 42) (ar/start state {:months 2}))
+        result (ar/run-frame (r/make-rng 43) running Long/MAX_VALUE)]
+    (is (= :contract (:event (first (:alert-log running)))))
+    (is (nil? (:message running)))
+    (is (empty? (:contract-msgs running)))
+    (is (= :contract (:event (first (:contract-msgs result)))))
+    (is (re-find #"messages to review" (:text (:message result))))))
+
+(deftest cancel-stops-the-run
+  (let [state (ar/start (game-state) {:months 12})
+        result (ar/cancel state)]
+    (is (nil? (:autorun result)))
+    (is (re-find #"Stopped after 0 months" (:text (:message result))))))
@@ -0,0 +1,41 @@
+(ns pharaoh.autosave-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.autosave :as as]
+            [pharaoh.state :as st]))
+
+(defn- app [state]
+  (merge {:state state} (as/init-timer 1000)))
+
+(deftest nothing-to-save-until-dirty
+  (is (nil? (as/next-save (app (st/initial-state)) 0))))
+
+(deftest dirty-game-saves-even-behind-a-dialog
+  (let [state (assoc (st/initial-state) :dirty true
+                     :dialog {:type :buy-sell :input "12"})]
+    (is (= (+ 1000 as/interval-ms) (as/next-save (app state) 0)))))
+
+(deftest finished-game-is-not-autosaved
+  (let [state (assoc (st/initial-state) :dirty true :game-over true)]
+    (is (nil? (as/next-save (app state) 0)))))
+
+(deftest run-writes-committed-state-once
+  (let [saved (atom [])
+        state (assoc (st/initial-state) :dirty true :gold 77.0
+                     :dialog {:type :buy-sell :input "12"})]
+    (with-redefs [as/save! (fn [s path] (swap! saved conj [s path]))]
+      (let [a (as/run (app state) 5000)
+            a (as/run a 9000)]
+        (is (= 1 (count @saved)))
+        (is (nil? (:dialog (ffirst @saved))))
+        (is (== 77.0 (:gold (ffirst @saved))))
+        (is (= (+ 9000 as/interval-ms) (:next-autosave a)))))))
+
+(deftest run-saves-again-after-a-change
+  (let [saved (atom 0)
+        state (assoc (st/initial-state) :dirty true)]
+    (with-redefs [as/save! (fn [_ _] (swap! saved inc))]
+      (-> (app state)
+          (as/run 5000)
+          (update :state assoc :gold 5.0)
+          (as/run 9000))
+      (is (= 2 @saved)))))
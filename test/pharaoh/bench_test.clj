@@ -0,0 +1,32 @@
+(ns pharaoh.bench-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.bench :as b])
+  (:import [java.util Locale]))
+
+(def ^:private report
+  {:jvm {:java "17.0.2" :cpus 8}
+   :benchmarks [{:name "URandom" :median_ns 12.5 :ops 1024 :alloc_bytes_per_op nil}
+                {:name "Run\"Month\"/late" :median_ns 1234567.125 :ops 64
+                 :alloc_bytes_per_op 2048.0}]})
+
+(deftest json-round-trips
+  (is (= report (b/read-json (b/write-json report))))
+  (is (= {:xs [1 -2.5 1.0E-4 true false nil] :s "a\\b\nc"}
+         (b/read-json "{\"xs\": [1, -2.5, 1e-4, true, false, null], \"s\": \"a\\\\b\\nc\"}"))))
+
+(deftest json-numbers-ignore-the-default-locale
+  (let [saved (Locale/getDefault)]
+    (try
+      (Locale/setDefault Locale/GERMANY)
+      (is (= "[1.500,\n 2]" (b/write-json [1.5 2])))
+      (finally (Locale/setDefault saved)))))
+
+(deftest regressions-are-flagged-past-the-threshold
+  (let [baseline [{:name "a" :median_ns 100.0} {:name "b" :median_ns 100.0}
+                  {:name "gone" :median_ns 5.0}]
+        current [{:name "a" :median_ns 109.0} {:name "b" :median_ns 111.0}
+                 {:name "new" :median_ns 1.0}]
+        rows (b/compare-runs baseline current 0.10)]
+    (is (= ["a" "b"] (map :name rows)))
+    (is (= [false true] (map :regressed rows)))
+    (is (< (Math/abs (- 0.11 (:change (second rows)))) 1e-9))))
@@ -0,0 +1,45 @@
+(ns pharaoh.commodities-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.commodities :as cm]
+            [pharaoh.economy :as ec]
+            [pharaoh.random :as r]
+            [pharaoh.timelapse :as tl]))
+
+(deftest codes-follow-contract-h
+  (is (= [:wheat :slaves :oxen :horses :manure :land] cm/codes))
+  (is (= 5 (cm/code :land)))
+  (is (= -1 (cm/code :gems))))
+
+(deftest table-gives-stock-and-health-keys
+  (is (= :ln-fallow (cm/amount-key :land)))
+  (is (= :wheat (cm/amount-key :wheat)))
+  (is (= :ox-health (cm/health-key :oxen)))
+  (is (nil? (cm/health-key :manure))))
+
+(deftest text-names-each-commodity
+  (is (= "horses" (cm/text :horses)))
+  (is (= "land" (cm/text :land))))
+
+(deftest orders-cover-every-commodity
+  (is (= (set cm/codes) (set cm/price-order) (set cm/market-order))))
+
+(deftest adjust-markets-runs-adjust-production-in-c-order
+  (let [state (tl/new-game (r/make-rng 42) "Normal")
+        rng-a (r/make-rng 7)
+        rng-b (r/make-rng 7)
+        expected (reduce (fn [s k]
+                           (let [res (ec/adjust-production
+                                       rng-b {:supply (get-in s [:supply k])
+                                              :demand (get-in s [:demand k])
+                                              :production (get-in s [:production k])
+                                              :price (get-in s [:prices k])}
+                                       (:world-growth s))]
+                             (-> s
+                                 (assoc-in [:supply k] (:supply res))
+                                 (assoc-in [:demand k] (:demand res))
+                                 (assoc-in [:production k] (:production res))
+                                 (assoc-in [:prices k] (:price res)))))
+                         state [:wheat :manure :slaves :horses :oxen :land])]
+    (is (= (select-keys expected [:supply :demand :production :prices])
+           (select-keys (cm/adjust-markets rng-a state (:world-growth state))
+                        [:supply :demand :production :prices])))))
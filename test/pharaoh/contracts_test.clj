@@ -270,9 +270,22 @@
         result (ct/contract-progress rng state)]
     (is (seq (:contract-msgs result)))
     (is (map? (first (:contract-msgs result))))
-    (is (string? (:text (first (:contract-msgs result)))))
+    (is (= :buy-complete (:outcome (first (:contract-msgs result)))))
     (is (number? (:face (first (:contract-msgs result)))))))
 
+(deftest settlement-queues-notice-without-text
+  (let [rng (r/make-rng 42)
+        players [{:pay-k 1.0 :ship-k 1.0 :default-k 1.0 :name "King HamuNam"}]
+        contract {:type :sell :who 0 :what :oxen :amount 20.0
+                  :price 2000.0 :duration 1 :active true :pct 0.0}
+        state (assoc (st/initial-state)
+                :gold 5000.0 :cont-pend [contract] :players players)
+        notice (first (:contract-msgs (ct/contract-progress rng state)))]
+    (is (= {:event :contract :outcome :complete :who 0 :what :oxen :amount 20.0}
+           (select-keys notice [:event :outcome :who :what :amount])))
+    (is (<= 0.0 (:draw notice) 1.0))
+    (is (not (contains? notice :text)))))
+
 (deftest default-generates-message
   (let [rng (r/make-rng 42)
         players [{:pay-k 1.0 :ship-k 1.0 :default-k 0.0 :name "King HamuNam"}]
@@ -294,3 +307,9 @@
                 :cont-pend [contract] :players players)
         result (ct/contract-progress rng state)]
     (is (vector? (:cont-pend result)))))
+
+(deftest months-to-default-follows-default-k
+  (let [rng (r/make-rng 5)]
+    (is (nil? (ct/months-to-default rng 1.0)))
+    (is (= 1 (ct/months-to-default rng 0.0)))
+    (is (every? pos? (repeatedly 100 #(ct/months-to-default rng 0.9))))))
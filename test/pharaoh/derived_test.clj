@@ -0,0 +1,34 @@
+(ns pharaoh.derived-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.derived :as dv]
+            [pharaoh.economy :as ec]
+            [pharaoh.state :as st]))
+
+(defn- estate []
+  (assoc (st/initial-state)
+    :slaves 100.0 :oxen 50.0 :horses 20.0 :ln-fallow 500.0
+    :manure 200.0 :wheat 1000.0 :gold 12345.0 :loan 2000.0))
+
+(deftest net-worth-is-assets-minus-loan
+  (let [s (estate)]
+    (is (== (- (ec/net-worth s) 2000.0) (dv/value s :net-worth)))))
+
+(deftest debt-asset-zero-without-loan
+  (is (== 0 (dv/value (assoc (estate) :loan 0.0) :debt-asset))))
+
+(deftest values-returns-requested-converters
+  (let [s (estate)]
+    (is (= #{:net-worth :total-land}
+           (set (keys (dv/values s [:net-worth :total-land])))))
+    (is (== 500.0 (dv/value s :total-land)))))
+
+(deftest memoized-until-inputs-change
+  (let [calls (atom 0)
+        s (assoc (estate) :gold 98765.0)]
+    (with-redefs [ec/net-worth (fn [_] (swap! calls inc) 1000.0)]
+      (dv/value s :net-worth)
+      (dv/value s :net-worth)
+      (dv/value (assoc s :message "unrelated") :net-worth)
+      (is (== 1 @calls))
+      (dv/value (assoc s :gold 1.0) :net-worth)
+      (is (== 2 @calls)))))
@@ -0,0 +1,48 @@
+(ns pharaoh.engine-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.contracts :as ct]
+            [pharaoh.engine :as eng]
+            [pharaoh.random :as r]
+            [pharaoh.simulation :as sim]
+            [pharaoh.state :as st]))
+
+(defn- game-state []
+  (assoc (st/initial-state)
+    :gold 100000.0 :wheat 5000.0 :slaves 50.0 :oxen 20.0 :horses 10.0
+    :ln-fallow 100.0 :sl-feed-rt 8.0 :overseers 3.0 :ov-pay 300.0
+    :players (ct/make-players (r/make-rng 1))))
+
+(defn- await-idle [engine]
+  (loop [n 0]
+    (when (and (eng/busy? engine) (< n 500))
+      (Thread/sleep 10)
+      (recur (inc n)))))
+
+(deftest run-job-publishes-the-same-month-as-do-run
+  (let [published (atom 0)
+        engine (eng/start #(swap! published inc))
+        state (game-state)]
+    (eng/submit! engine {:kind :run :rng (r/make-rng 42) :state state})
+    (await-idle engine)
+    (is (not (eng/busy? engine)))
+    (is (= 1 (:seq (eng/latest engine))))
+    (is (= (sim/do-run (r/make-rng 42) state) (:state (eng/latest engine))))
+    (is (pos? @published))))
+
+(deftest autorun-publishes-every-month
+  (let [engine (eng/start (fn []))]
+    (eng/submit! engine {:kind :autorun :rng (r/make-rng 42) :state (game-state)
+                         :opts {:months 4}})
+    (await-idle engine)
+    (is (= 4 (:seq (eng/latest engine))))
+    (is (nil? (:autorun (:state (eng/latest engine)))))))
+
+(deftest cancel-stops-an-autorun
+  (let [engine (eng/start (fn []))]
+    (eng/cancel! engine)
+    (eng/submit! engine {:kind :autorun :rng (r/make-rng 42) :state (game-state)
+                         :opts {:months 1000}})
+    (eng/cancel! engine)
+    (await-idle engine)
+    (is (< (:seq (eng/latest engine)) 1000))
+    (is (nil? (:autorun (:state (eng/latest engine)))))))
@@ -0,0 +1,49 @@
+(ns pharaoh.ensemble-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.ensemble :as en]
+            [pharaoh.telemetry :as tm])
+  (:import [java.io File]
+           [java.util.concurrent.atomic AtomicBoolean AtomicLong]))
+
+(def ^:private spec
+  {:policies ["default" "idle"] :levels ["Easy"] :seeds [1 2 3] :months 6})
+
+(deftest runs-are-keyed-by-policy-level-and-seed
+  (is (= {:policy "idle" :level "Easy" :seed 1} (nth (en/runs spec) 3))))
+
+(deftest results-do-not-depend-on-threads
+  (let [one (en/run (assoc spec :threads 1))
+        four (en/run (assoc spec :threads 4))]
+    (is (= 6 (count one)))
+    (is (= one four))
+    (is (= (range 6) (map :run one)))))
+
+(deftest telemetry-gets-every-month
+  (let [f (doto (File/createTempFile "pharaoh" ".ptl") (.deleteOnExit))
+        w (tm/open-writer (.getPath f) [["gold" [:gold]]] {:rows 8 :max-buffers 10})
+        results (en/run (assoc spec :threads 2 :telemetry w))]
+    (tm/close! w)
+    (is (= (reduce + (map :months results))
+           (count (:run (tm/read-file (.getPath f))))))))
+
+(deftest an-interrupted-sweep-resumes-to-the-same-results
+  (let [f (doto (File/createTempFile "pharaoh" ".ckpt") (.delete) (.deleteOnExit))
+        spec (assoc spec :months 12 :threads 2)
+        expected (en/run spec)
+        cancel (AtomicBoolean.)
+        months (AtomicLong.)
+        ckpt {:path (.getPath f) :every-ms 5}
+        stopped (en/run (assoc spec :checkpoint ckpt :cancel cancel
+                               :on-month (fn [_ _] (when (= 20 (.incrementAndGet months))
+                                                     (.set cancel true)))))]
+    (is (nil? stopped))
+    (is (.exists f))
+    (is (= expected (en/run (assoc spec :checkpoint ckpt))))
+    (is (= expected (en/run (assoc spec :checkpoint ckpt))))))
+
+(deftest a-checkpoint-from-another-sweep-is-refused
+  (let [f (doto (File/createTempFile "pharaoh" ".ckpt") (.delete) (.deleteOnExit))
+        ckpt {:path (.getPath f) :every-ms 60000}]
+    (en/run (assoc spec :checkpoint ckpt))
+    (is (thrown? clojure.lang.ExceptionInfo
+                 (en/run (assoc spec :months 7 :checkpoint ckpt))))))
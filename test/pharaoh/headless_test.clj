@@ -0,0 +1,29 @@
+(ns pharaoh.headless-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.headless :as hl]
+            [pharaoh.random :as r]
+            [pharaoh.timelapse :as tl]))
+
+(deftest parse-script-reads-keys-and-names
+  (is (= [[\w nil] [\b nil] [\1 nil] [\0 nil] [\return nil] [\r nil]]
+         (hl/parse-script "w b 10 <enter>  # buy wheat\nr")))
+  (is (= [[(char 27) nil] [(char 0xFFFF) :down]]
+         (hl/parse-script "<esc><down>"))))
+
+(deftest parse-script-rejects-unknown-names
+  (is (thrown? clojure.lang.ExceptionInfo (hl/parse-script "<tab>"))))
+
+(deftest scripted-purchase-goes-through-the-dialog
+  (let [rng (r/make-rng 42)
+        state (assoc (tl/new-game rng "Normal") :gold 1e6)
+        after (:state (hl/run-script rng state (hl/parse-script "w b 100 <enter>")))]
+    (is (nil? (:dialog after)))
+    (is (> (:wheat after) (:wheat state)))))
+
+(deftest runs-months-and-acknowledges-messages
+  (let [rng (r/make-rng 42)
+        state (tl/new-game rng "Normal")
+        {:keys [state log]} (hl/run-script rng state (repeat 6 [\r nil]))]
+    (is (every? string? log))
+    (is (nil? (:message state)))
+    (is (or (:game-over state) (pos? (:month state))))))
@@ -0,0 +1,62 @@
+(ns pharaoh.history-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.history :as h]
+            [pharaoh.random :as r]
+            [pharaoh.timelapse :as tl]))
+
+(deftest chunks-round-trip-exactly
+  (let [rng (r/make-rng 42)
+        values (vec (for [i (range h/chunk-size)]
+                      (case (mod i 4)
+                        0 0.0
+                        1 (r/uniform rng -1e6 1e6)
+                        2 (double i)
+                        3 Double/NaN)))
+        decoded (vec (h/decode-chunk (h/encode-chunk values)))]
+    (is (= (map #(Double/doubleToRawLongBits %) values)
+           (map #(Double/doubleToRawLongBits %) decoded)))))
+
+(deftest steady-values-pack-small
+  (let [chunk (h/encode-chunk (repeat h/chunk-size 1234.5))]
+    (is (= 2 (alength ^longs (:bits chunk))))))
+
+(defn- game-history [months]
+  (let [rng (r/make-rng 42)
+        states (take months (iterate #(tl/batch-month rng %) (tl/new-game rng "Easy")))]
+    [(reduce h/record (h/empty-history) states) (vec states)]))
+
+(deftest columns-read-back-any-range
+  (let [[hist states] (game-history 150)]
+    (is (= 150 (:months hist)))
+    (is (= (map #(double (:gold %)) (subvec states 60 140))
+           (vec (h/column hist "gold" 60 140))))
+    (is (= (double (:py-height (peek states))) (h/latest hist "pyHeight")))
+    (is (= 5 (alength (h/column hist "gold" 145 999))))))
+
+(deftest record-skips-repeats-and-restarts-on-older-months
+  (let [rng (r/make-rng 1)
+        s0 (tl/new-game rng "Easy")
+        s1 (tl/batch-month rng s0)
+        hist (-> (h/empty-history) (h/record s0) (h/record s1) (h/record s1))]
+    (is (= 2 (:months hist)))
+    (is (= 1 (:months (h/record hist s0))))))
+
+(deftest skipped-months-are-padded-with-nan
+  (let [hist (reduce h/record (h/empty-history [["x" [:x]]])
+                     [{:year 1 :month 1 :x 1.0} {:year 1 :month 2 :x 2.0}
+                      {:year 1 :month 5 :x 5.0}])
+        xs (vec (h/column hist "x" 0 5))]
+    (is (= 5 (:months hist)))
+    (is (= 17 (h/last-month hist)))
+    (is (= [1.0 2.0] (subvec xs 0 2)))
+    (is (every? #(Double/isNaN %) (subvec xs 2 4)))
+    (is (= 5.0 (xs 4)))))
+
+(deftest trend-is-the-fitted-slope
+  (let [hist (reduce h/append (h/empty-history [["x" [:x]]])
+                     (for [i (range 100)] {:year 0 :month i :x (+ 7.0 (* 3.0 i))}))]
+    (is (< (Math/abs (- 3.0 (h/trend hist "x" 24))) 1e-9))))
+
+(deftest a-whole-game-fits-in-tens-of-kilobytes
+  (let [[hist _] (game-history 480)]
+    (is (< (h/byte-size hist) 100000))))
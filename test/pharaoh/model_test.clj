@@ -0,0 +1,124 @@
+(ns pharaoh.model-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.model :as m]
+            [pharaoh.random :as r]
+            [pharaoh.state :as st]
+            [pharaoh.tables :as t]
+            [pharaoh.workload :as wk]))
+
+(def tiny-model
+  {:inputs [:a :b]
+   :outputs [:total]
+   :equations
+   '[{:id :total :expr (+ doubled halved)}
+     {:id :doubled :expr (* a 2)}
+     {:id :noisy :noise 0.1 :expr (* b 100)}
+     {:id :halved :expr (/ b 2)}
+     {:id :unused :expr (- a b)}]})
+
+(m/defkernel tiny-kernel tiny-model)
+(m/defkernel tiny-noisy-kernel tiny-model [:total :noisy])
+
+(deftest dependency-order-puts-inputs-first
+  (let [order (mapv :id (m/dependency-order tiny-model))]
+    (is (< (.indexOf order :doubled) (.indexOf order :total)))
+    (is (< (.indexOf order :halved) (.indexOf order :total)))))
+
+(deftest dependency-order-rejects-cycles
+  (is (thrown? clojure.lang.ExceptionInfo
+               (m/dependency-order {:equations '[{:id :x :expr (inc y)}
+                                                 {:id :y :expr (inc x)}]}))))
+
+(deftest live-vars-eliminates-dead-equations
+  (is (= #{:total :doubled :halved} (m/live-vars tiny-model [:total]))))
+
+(deftest kernel-computes-requested-outputs
+  (is (= {:total 9} (tiny-kernel (r/make-rng 1) {:a 4 :b 2}))))
+
+(deftest dead-noise-still-draws
+  (let [rng1 (r/make-rng 7)
+        rng2 (r/make-rng 7)]
+    (tiny-kernel rng1 {:a 1 :b 1})
+    (tiny-noisy-kernel rng2 {:a 1 :b 1})
+    (is (== (.nextDouble rng1) (.nextDouble rng2)))))
+
+;; The hand-written converter chain the kernel replaces.
+(defn- reference-capacity [rng state]
+  (let [sl-dth-k (* (t/interpolate (:sl-health state) t/slave-death)
+                    (r/abs-gaussian rng 1.0 0.1))
+        sl-brth-k (* (t/interpolate (:sl-health state) t/slave-birth)
+                     (r/abs-gaussian rng 1.0 0.1))
+        wk-able (* (t/interpolate (:sl-health state) t/work-ability)
+                   (r/abs-gaussian rng 1.0 0.1))
+        hs-eff (* (t/interpolate (:hs-health state) t/horse-efficiency)
+                  (r/abs-gaussian rng 1.0 0.1))
+        hs-dth-k (* (t/interpolate (:hs-health state) t/horse-death)
+                    (r/abs-gaussian rng 1.0 0.1))
+        hs-brth-k (* (t/interpolate (:hs-health state) t/horse-birth)
+                     (r/abs-gaussian rng 1.0 0.1))
+        ox-eff (* (t/interpolate (:ox-health state) t/oxen-efficiency)
+                  (r/abs-gaussian rng 1.0 0.1))
+        ox-dth-k (* (t/interpolate (:ox-health state) t/oxen-death)
+                    (r/abs-gaussian rng 1.0 0.1))
+        ox-brth-k (* (t/interpolate (:ox-health state) t/oxen-birth)
+                     (r/abs-gaussian rng 1.0 0.1))
+        ox-sl (if (pos? (:slaves state)) (/ (:oxen state) (:slaves state)) 0)
+        sl-ov (/ (:slaves state) (+ (:overseers state) 1))
+        hs-ov (if (pos? (:overseers state))
+                (/ (:horses state) (:overseers state)) 0)
+        ov-eff (* (t/interpolate (* hs-ov hs-eff) t/overseer-effectiveness)
+                  (r/abs-gaussian rng 1.0 0.1))
+        ov-eff-sl (if (pos? sl-ov) (/ ov-eff sl-ov) 0)
+        stress-lash (* (t/interpolate (:ov-press state) t/stress-lash)
+                       (r/abs-gaussian rng 1.0 0.1))
+        sl-lash-rt (* stress-lash ov-eff-sl)
+        pos-motive (* (t/interpolate ov-eff-sl t/positive-motive)
+                      (r/abs-gaussian rng 1.0 0.1))
+        neg-motive (t/interpolate sl-lash-rt t/negative-motive)
+        ox-mult (max (* (t/interpolate ox-sl t/ox-mult) ox-eff) 1)]
+    {:sl-dth-k sl-dth-k :sl-brth-k sl-brth-k :wk-able wk-able
+     :hs-dth-k hs-dth-k :hs-brth-k hs-brth-k :ox-dth-k ox-dth-k
+     :ox-brth-k ox-brth-k :ov-eff-sl ov-eff-sl :sl-lash-rt sl-lash-rt
+     :ox-mult ox-mult
+     :max-wk-sl (* (+ pos-motive neg-motive) wk-able ox-mult)}))
+
+(deftest slave-capacity-kernel-matches-hand-written-model
+  (let [state (assoc (st/initial-state)
+                :slaves 120.0 :oxen 40.0 :horses 9.0 :overseers 4.0
+                :sl-health 0.8 :ox-health 0.7 :hs-health 0.9 :ov-press 1.5)
+        expected (reference-capacity (r/make-rng 42) state)
+        actual (wk/slave-capacity (r/make-rng 42) state)]
+    (doseq [[k v] expected]
+      (is (== v (get actual k)) (str k)))))
+
+(m/deftangent tiny-tangent tiny-model :b)
+(m/deftangent capacity-by-health wk/capacity-model :sl-health wk/core-outputs)
+
+(deftest tangent-kernel-differentiates-outputs
+  (let [{:keys [value tangent]} (tiny-tangent (r/make-rng 1) {:a 4 :b 2})]
+    (is (= {:total 9} value))
+    (is (== 0.5 (:total tangent)))))
+
+(deftest tangent-kernel-draws-like-the-scalar-kernel
+  (let [rng1 (r/make-rng 7)
+        rng2 (r/make-rng 7)]
+    (tiny-kernel rng1 {:a 1 :b 1})
+    (tiny-tangent rng2 {:a 1 :b 1})
+    (is (== (.nextDouble rng1) (.nextDouble rng2)))))
+
+;; Tables are piecewise linear, so away from a breakpoint a small
+;; finite difference, with the same noise, matches the tangent.
+(deftest capacity-tangent-matches-finite-difference
+  (let [state (assoc (st/initial-state)
+                :slaves 120.0 :oxen 40.0 :horses 9.0 :overseers 4.0
+                :sl-health 0.83 :ox-health 0.7 :hs-health 0.9 :ov-press 1.5)
+        h 1e-6
+        at (fn [s] (wk/slave-capacity-core (r/make-rng 42) s))
+        lo (at state)
+        hi (at (update state :sl-health + h))
+        {:keys [value tangent]} (capacity-by-health (r/make-rng 42) state)]
+    (doseq [k wk/core-outputs]
+      (is (== (get lo k) (get value k)) (str k))
+      (is (< (Math/abs (- (/ (- (get hi k) (get lo k)) h) (get tangent k)))
+             (* 1e-3 (max 1.0 (Math/abs (double (get tangent k))))))
+          (str k)))))
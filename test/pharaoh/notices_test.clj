@@ -0,0 +1,57 @@
+(ns pharaoh.notices-test
+  (:require [clojure.string :as str]
+            [clojure.test :refer :all]
+            [pharaoh.contracts :as ct]
+            [pharaoh.events :as ev]
+            [pharaoh.messages :as msg]
+            [pharaoh.notices :as nt]
+            [pharaoh.random :as r]
+            [pharaoh.simulation :as sim]
+            [pharaoh.state :as st]))
+
+(def players [{:name "King HamuNam"}])
+
+(deftest contract-notice-renders-contract-message
+  (let [notice {:event :contract :outcome :complete :who 0 :what :wheat
+                :amount 500.0 :draw 0.0 :face 0}]
+    (is (= (ct/contract-msg notice players
+                            (first msg/contract-complete-messages))
+           (nt/text {:players players} notice)))))
+
+(deftest contract-notice-picks-like-a-live-pick
+  (let [pool (ct/outcome-messages :default)
+        live (msg/pick (r/make-rng 5) pool)
+        draw (r/uniform (r/make-rng 5) 0.0 1.0)
+        notice {:event :contract :outcome :default :who 0 :what :oxen
+                :amount 10.0 :draw draw :face 0}]
+    (is (str/ends-with? (nt/text {:players players} notice) live))))
+
+(deftest random-notice-renders-same-text-as-live-message
+  (doseq [etype (keys ev/message-picks)]
+    (let [live-rng (r/make-rng 9)
+          live (ev/event-message live-rng etype nil)
+          rng (r/make-rng 9)
+          notice {:event :random :type etype :draws (ev/message-draws rng etype)}]
+      (is (= live (nt/text {} notice)) (str etype))
+      (is (== (.nextDouble live-rng) (.nextDouble rng))
+          (str etype " draws the same amount")))))
+
+(deftest plain-messages-pass-through
+  (is (= {:text "Hello" :face 2} (nt/render {} {:text "Hello" :face 2}))))
+
+(deftest pop-next-renders-the-head-of-the-queue
+  (let [state {:players players
+               :contract-msgs [{:event :contract :outcome :complete :who 0
+                                :what :wheat :amount 5.0 :draw 0.0 :face 0}
+                               {:text "later" :face 1}]}
+        result (nt/pop-next state)]
+    (is (string? (:text (:message result))))
+    (is (= [{:text "later" :face 1}] (:contract-msgs result)))))
+
+(deftest advance-leaves-event-text-unbuilt
+  (let [state (assoc (st/initial-state) :players (ct/make-players (r/make-rng 1)))
+        result (sim/advance (r/make-rng 4171) state)]
+    (is (= :random (:event (:notice result))))
+    (is (not (contains? (:notice result) :text)))
+    (is (= (:text (:message (sim/do-run (r/make-rng 4171) state)))
+           (nt/text result (:notice result))))))
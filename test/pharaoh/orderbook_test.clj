@@ -0,0 +1,82 @@
+(ns pharaoh.orderbook-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.contracts :as ct]
+            [pharaoh.orderbook :as ob]
+            [pharaoh.random :as r]))
+
+(defn- offer [who what]
+  {:type :buy :who who :what what :amount 100.0 :price 5000.0 :duration 20})
+
+(defn- book-with [rng n now]
+  (reduce (fn [b i] (ob/add-offer rng b (offer i (if (even? i) :wheat :oxen)) now))
+          (ob/empty-book) (range n)))
+
+(deftest offers-are-indexed-by-player-and-commodity
+  (let [b (book-with (r/make-rng 1) 1000 0)]
+    (is (ob/trading? b 7 :oxen))
+    (is (not (ob/trading? b 7 :wheat)))
+    (is (= 500 (count (ob/contracts-in b :wheat))))
+    (is (= [7] (map :who (ob/contracts-of b 7))))))
+
+(deftest one-contract-per-player-and-commodity
+  (let [b (book-with (r/make-rng 1) 1 0)]
+    (is (= b (ob/add-offer (r/make-rng 2) b (offer 0 :wheat) 0)))))
+
+(deftest offer-price-drifts-with-age
+  (let [b (book-with (r/make-rng 1) 1 0)
+        c (ob/contract b 0)]
+    (is (== 5000.0 (ob/offer-price c 0)))
+    (is (< 5000.0 (ob/offer-price c 3)))))
+
+(deftest offers-are-withdrawn-with-eight-months-left
+  (let [b (book-with (r/make-rng 1) 3 0)
+        {quiet :events} (ob/step-month b 11)
+        {:keys [book events]} (ob/step-month b 12)]
+    (is (empty? quiet))
+    (is (= [:withdrawn :withdrawn :withdrawn] (map :kind events)))
+    (is (empty? (:contracts book)))
+    (is (not (ob/trading? book 0 :wheat)))))
+
+(deftest accepted-contract-comes-due-when-it-never-defaults
+  (let [b (ob/accept (r/make-rng 3) (book-with (r/make-rng 1) 1 0) 0 2 {:default-k 1.0})
+        c (ob/contract b 0)]
+    (is (= :pending (:status c)))
+    (is (= 20 (:due c)))
+    (is (empty? (:events (ob/step-month b 19))))
+    (is (= [:due] (map :kind (:events (ob/step-month b 20)))))))
+
+(deftest unreliable-player-defaults-early
+  (let [b (ob/accept (r/make-rng 3) (book-with (r/make-rng 1) 1 0) 0 0 {:default-k 0.0})]
+    (is (= [:default] (map :kind (:events (ob/step-month b 1)))))))
+
+(deftest default-month-follows-the-monthly-chance
+  (let [rng (r/make-rng 9)
+        b (book-with (r/make-rng 1) 1 0)
+        n 4000
+        defaults (count (filter #(:defaults? (ob/contract (ob/accept rng b 0 0 {:default-k 0.97}) 0))
+                                (range n)))
+        expected (* n (- 1.0 (Math/pow 0.97 20)))]
+    (is (< (Math/abs (- defaults expected)) (* 0.05 n)))))
+
+(deftest step-month-touches-only-due-buckets
+  (let [b (book-with (r/make-rng 1) 2000 0)
+        b (ob/add-offer (r/make-rng 2) b (assoc (offer 5000 :land) :duration 10) 0)
+        {:keys [book events]} (ob/step-month b 2)]
+    (is (= [5000] (map (comp :who :contract) events)))
+    (is (= 2000 (count (:contracts book))))))
+
+(deftest reschedule-puts-a-partial-contract-back
+  (let [b (ob/accept (r/make-rng 3) (book-with (r/make-rng 1) 1 0) 0 0 {:default-k 1.0})
+        {:keys [book events]} (ob/step-month b 20)
+        c (:contract (first events))
+        b2 (ob/reschedule book (assoc c :amount 40.0) 21)]
+    (is (= [:due] (map :kind (:events (ob/step-month b2 21)))))))
+
+;; ContProg checks for a default before settling, so a default drawn
+;; for the due month itself still happens.
+(deftest default-in-the-due-month-is-kept
+  (let [k (ct/months-to-default (r/make-rng 3) 0.9)
+        b (ob/add-offer (r/make-rng 1) (ob/empty-book) (assoc (offer 0 :wheat) :duration k) 0)
+        b (ob/accept (r/make-rng 3) b 0 0 {:default-k 0.9})]
+    (is (:defaults? (ob/contract b 0)))
+    (is (= [:default] (map :kind (:events (ob/step-month b k)))))))
@@ -0,0 +1,71 @@
+(ns pharaoh.protocol-test
+  (:require [clojure.string :as str]
+            [clojure.test :refer :all]
+            [pharaoh.protocol :as p]
+            [pharaoh.random :as r]
+            [pharaoh.simulation :as sim]
+            [pharaoh.timelapse :as tl]
+            [pharaoh.transactions :as tx])
+  (:import [java.io BufferedReader StringReader StringWriter]))
+
+(defn- session [seed]
+  (let [rng (r/make-rng seed)]
+    {:rng rng :state (tl/new-game rng "Normal")}))
+
+(deftest batch-gives-one-result-per-command
+  (let [[s reply] (p/execute (session 42) "feed oxen 60; plant 10; get oxFeedRt lnToSew")]
+    (is (= "ok 60;ok 10;60 10" reply))
+    (is (== 60.0 (:ox-feed-rt (:state s))))))
+
+(deftest orders-report-errors
+  (let [[_ reply] (p/execute (session 42) "sell oxen 999999; buy gems 1; frobnicate")]
+    (is (= ["error not-owned" "error unknown-commodity" "error unknown-command"]
+           (map #(str/join " " (take 2 (str/split % #" ")))
+                (str/split reply #";"))))))
+
+;; An exception's text must not split or end the reply.
+(deftest exception-text-keeps-the-framing
+  (let [apply-order tx/apply-order
+        errors (atom [(RuntimeException. "bad; worse\nworst") (IllegalStateException.)])]
+    (with-redefs [tx/apply-order (fn [& args]
+                                   (if-let [e (first @errors)]
+                                     (do (swap! errors rest) (throw e))
+                                     (apply apply-order args)))]
+      (let [[_ reply] (p/execute (session 42) "plant 10; plant 20; plant 30")]
+        (is (= ["error bad  worse worst" "error java.lang.IllegalStateException" "ok 30"]
+               (str/split reply #";")))))))
+
+(deftest run-advances-months
+  (let [[s reply] (p/execute (session 42) "run 3")
+        state (:state s)]
+    (is (str/starts-with? reply "ok "))
+    (is (= (str "ok " (:year state) " " (:month state)) reply))
+    (is (nil? (:message state)))))
+
+(deftest run-matches-the-simulation
+  (let [{:keys [state]} (session 42)
+        rng (r/make-rng 99)
+        [s _] (p/execute {:rng rng :state state} "run 1")]
+    (is (= (:gold (sim/advance (r/make-rng 99) state))
+           (:gold (:state s))))))
+
+(deftest accept-moves-an-offer-to-pending
+  (let [s (first (p/execute (session 42) "run 2"))
+        offers (read-string (second (p/execute s "offers")))]
+    (if-let [i (:index (first offers))]
+      (let [[s reply] (p/execute s (str "accept " i))]
+        (is (= "ok" reply))
+        (is (= 1 (count (read-string (second (p/execute s "pending")))))))
+      (is (empty? offers)))))
+
+(deftest serve-answers-pipelined-lines-in-order
+  (let [out (StringWriter.)]
+    (p/serve (session 42)
+             (BufferedReader. (StringReader. "plant 1\nplant 2;plant 3\nquit\nplant 4\n"))
+             out)
+    (is (= "ok 1\nok 2;ok 3\nbye\n" (str out)))))
+
+(deftest new-starts-a-fresh-game
+  (let [[s reply] (p/execute (session 42) "run 5; new Easy 7")]
+    (is (= "ok" (last (str/split reply #";"))))
+    (is (= 1 (:month (:state s))))))
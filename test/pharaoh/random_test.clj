@@ -72,3 +72,13 @@
         v1 (repeatedly 10 #(r/uniform rng1 0.0 1.0))
         v2 (repeatedly 10 #(r/uniform rng2 0.0 1.0))]
     (is (= v1 v2))))
+
+(deftest restore-continues-the-stream
+  (let [rng (r/make-rng 42)
+        _ (dotimes [_ 10] (r/uniform rng 0 1))
+        _ (r/gaussian rng 0 1)
+        copy (r/restore (r/snapshot rng))]
+    (is (= (repeatedly 5 #(r/gaussian rng 0 1))
+           (repeatedly 5 #(r/gaussian copy 0 1))))
+    (is (= (repeatedly 5 #(r/uniform rng 0 1))
+           (repeatedly 5 #(r/uniform copy 0 1))))))
@@ -0,0 +1,56 @@
+(ns pharaoh.results-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.ensemble :as en]
+            [pharaoh.results :as res]))
+
+;; Synthetic summaries, enough rows to span several zone-map blocks.
+(defn- summary [i]
+  (let [bankrupt? (zero? (mod i 3))]
+    {:policy (if (even? i) "default" "idle") :level "Easy" :seed i
+     :run i :months 480
+     :outcome (if bankrupt? :bankrupt :survived)
+     :bankrupt-month (when bankrupt? (+ 13 (mod i 120)))
+     :bankrupt-year (when bankrupt? (inc (quot (+ 12 (mod i 120)) 12)))
+     :gold (double i) :py-height 0.0 :net-worth 0.0
+     :min {"slHealth" (/ (mod i 100) 100.0)}
+     :max {"slHealth" 1.0}}))
+
+(def ^:private rows (mapv summary (range 10000)))
+(def ^:private store (res/build rows))
+
+(defn- brute [pred] (set (map :seed (filter pred rows))))
+(defn- answer [q] (set (map :seed (res/select store (res/query store q)))))
+
+(deftest bitmap-and-zone-queries-match-a-scan
+  (is (= (brute #(and (= "idle" (:policy %)) (= :bankrupt (:outcome %))
+                      (< (:bankrupt-year %) 5) (> (get-in % [:min "slHealth"]) 0.8)))
+         (answer [:and [:= :policy "idle"] [:= :outcome :bankrupt]
+                  [:< :bankrupt-year 5] [:> [:min "slHealth"] 0.8]]))))
+
+(deftest numeric-ranges-honour-bounds
+  (is (= (brute #(<= 4000.0 (:gold %) 8191.0)) (answer [:between :gold 4000 8191])))
+  (is (= (brute #(< (:gold %) 4096.0)) (answer [:< :gold 4096])))
+  (is (= (brute #(and (:bankrupt-month %) (>= (:bankrupt-month %) 100)))
+         (answer [:>= :bankrupt-month 100]))))
+
+(deftest or-not-and-in
+  (is (= (brute #(not= :bankrupt (:outcome %))) (answer [:not [:= :outcome :bankrupt]])))
+  (is (= (brute #(#{1 2} (:bankrupt-year %)))
+         (answer [:or [:= :bankrupt-year 1] [:= :bankrupt-year 2]])))
+  (is (= 10000 (res/count-of store [:in :policy ["default" "idle" "other"]]))))
+
+(deftest bad-columns-are-rejected-alike
+  (doseq [q [[:= :colour "red"] [:< :colour 3] [:> [:min "oxHealth"] 0.5]
+             [:< :policy "x"] [:between :outcome :a :z]]]
+    (is (thrown? clojure.lang.ExceptionInfo (res/query store q)) (pr-str q)))
+  (is (zero? (res/count-of store [:= :policy "other"]))))
+
+(deftest runs-are-found-by-key
+  (is (= 42 (:seed (res/lookup store "default" 42 "Easy"))))
+  (is (nil? (res/lookup store "idle" 42 "Easy"))))
+
+(deftest builds-from-ensemble-summaries
+  (let [s (res/build (en/run {:policies ["idle"] :levels ["Easy"] :seeds [1 2]
+                              :months 3 :threads 1}))]
+    (is (= 2 (res/count-of s [:= :outcome :survived])))
+    (is (= 2 (res/count-of s [:>= [:max "pyHeight"] 0])))))
@@ -0,0 +1,61 @@
+(ns pharaoh.scheduler-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.scheduler :as sch]))
+
+(def wheel (sch/make-wheel 100 8 0))
+
+(deftest nothing-due-on-an-empty-wheel
+  (is (nil? (sch/next-due wheel)))
+  (is (= [] (second (sch/expire wheel 10000)))))
+
+(deftest jobs-fire-when-due-earliest-first
+  (let [w (-> wheel (sch/schedule :b 500) (sch/schedule :a 250))
+        [w1 early] (sch/expire w 200)
+        [w2 fired] (sch/expire w1 600)]
+    (is (= [] early))
+    (is (= [:a :b] fired))
+    (is (nil? (sch/next-due w2)))))
+
+(deftest jobs-beyond-one-rotation-wait-for-their-turn
+  (let [w (sch/schedule wheel :far 2050)
+        [w1 fired] (sch/expire w 1000)
+        [_ later] (sch/expire w1 2100)]
+    (is (= [] fired))
+    (is (= 2050 (sch/due-at w1 :far)))
+    (is (= [:far] later))))
+
+(deftest past-deadlines-fire-on-the-next-expire
+  (let [[w _] (sch/expire wheel 5000)
+        w (sch/schedule w :late 100)
+        [_ fired] (sch/expire w 5000)]
+    (is (= [:late] fired))))
+
+(deftest rescheduling-replaces-the-old-deadline
+  (let [w (-> wheel (sch/schedule :x 200) (sch/schedule :x 700))
+        [w1 early] (sch/expire w 300)
+        [_ fired] (sch/expire w1 800)]
+    (is (= [] early))
+    (is (= [:x] fired))))
+
+(deftest cancel-removes-a-job
+  (let [w (-> wheel (sch/schedule :x 200) (sch/cancel :x))]
+    (is (nil? (sch/next-due w)))
+    (is (= [] (second (sch/expire w 1000))))))
+
+(deftest run-due-runs-jobs-and-resyncs
+  (let [jobs {:tick {:run (fn [app now] (-> app (update :count inc) (assoc :last now)))
+                     :next (fn [app _] (+ (:last app) 300))}}
+        app {:count 0 :last 0 :timers wheel}
+        app (assoc app :timers (sch/sync-jobs (:timers app) jobs app 0))
+        app (sch/run-due app jobs 100)
+        app2 (sch/run-due app jobs 350)]
+    (is (= 0 (:count app)))
+    (is (= 1 (:count app2)))
+    (is (= 650 (sch/next-due (:timers app2))))))
+
+(deftest sync-jobs-cancels-jobs-with-no-deadline
+  (let [jobs {:maybe {:run (fn [app _] app)
+                      :next (fn [app _] (:at app))}}
+        w (sch/sync-jobs wheel jobs {:at 400} 0)]
+    (is (= 400 (sch/next-due w)))
+    (is (nil? (sch/next-due (sch/sync-jobs w jobs {:at nil} 0))))))
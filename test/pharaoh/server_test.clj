@@ -0,0 +1,61 @@
+(ns pharaoh.server-test
+  (:require [clojure.string :as str]
+            [clojure.test :refer :all]
+            [pharaoh.server :as srv])
+  (:import [java.io BufferedReader StringReader StringWriter]))
+
+(defmacro with-server [[sym opts] & body]
+  `(let [~sym (srv/make-server ~opts)]
+     (try ~@body (finally (srv/stop! ~sym)))))
+
+(deftest sessions-share-one-market
+  (with-server [s {:shards 2 :seed 5 :difficulty "Easy"}]
+    (let [ids (vec (repeatedly 3 #(srv/join! s)))]
+      (srv/tick! s)
+      (is (= 1 @(:month s)))
+      (is (apply = (map #(get-in (srv/session s %) [:state :prices]) ids)))
+      (is (= (:prices @(:market s))
+             (get-in (srv/session s (first ids)) [:state :prices]))))))
+
+(deftest purchases-are-batched-into-the-tick
+  (with-server [s {:shards 2 :seed 5 :difficulty "Easy"}]
+    (let [a (srv/join! s)
+          b (srv/join! s)]
+      (is (= ["ok 5" false] (srv/command! s a "buy horses 5")))
+      (srv/command! s b "buy horses 7")
+      (is (== 12.0 (:horses (srv/tick! s)))))))
+
+;; Commands keep arriving while ticks run; a trade that lands between a
+;; shard's month and the publish must still reach a later tick.
+(deftest trades-during-a-tick-are-not-lost
+  (with-server [s {:shards 1 :seed 5 :difficulty "Easy"}]
+    (let [id (srv/join! s)
+          buys (future (count (filter #(= ["ok 1" false] %)
+                                      (repeatedly 400 #(srv/command! s id "buy horses 1")))))
+          during (vec (repeatedly 20 #(srv/tick! s)))
+          bought @buys
+          after (srv/tick! s)]
+      (is (pos? bought))
+      (is (== bought (reduce + (map #(get % :horses 0.0) (conj during after))))))))
+
+(deftest months-only-pass-on-the-tick
+  (with-server [s {:shards 1}]
+    (let [id (srv/join! s)
+          [reply _] (srv/command! s id "run 3;new Easy;get month")]
+      (is (= ["error scheduled" "error scheduled"]
+             (take 2 (str/split reply #";")))))))
+
+(deftest the-load-script-is-served-without-errors
+  (with-server [s {:shards 1}]
+    (let [id (srv/join! s)
+          replies (mapv #(first (srv/command! s id %)) @#'srv/load-script)]
+      (is (not-any? #(str/includes? % "error") replies) (pr-str replies))
+      ;; get answers a number for every variable.
+      (is (every? #(re-matches #"-?[0-9.E]+" %) (str/split (first replies) #" "))))))
+
+(deftest serve-answers-each-line-and-leaves
+  (with-server [s {:shards 2}]
+    (let [out (StringWriter.)]
+      (srv/serve s (BufferedReader. (StringReader. "plant 10\nquit\nplant 5\n")) out)
+      (is (= "ok 10\nbye\n" (str out)))
+      (is (nil? (srv/session s 0))))))
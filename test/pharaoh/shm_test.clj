@@ -0,0 +1,80 @@
+(ns pharaoh.shm-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.contracts :as ct]
+            [pharaoh.random :as r]
+            [pharaoh.shm :as shm]
+            [pharaoh.simulation :as sim]
+            [pharaoh.state :as st])
+  (:import [java.io File]))
+
+(defn- temp-path []
+  (let [f (File/createTempFile "pharaoh-shm" ".bin")]
+    (.deleteOnExit f)
+    (.getPath f)))
+
+(defn- game-state []
+  (assoc (st/initial-state)
+    :gold 12345.0 :loan 500.0 :py-height 3.5 :month 4 :year 2
+    :players (ct/make-players (r/make-rng 1))
+    :cont-pend [{:type :buy :who 2 :what :oxen :amount 40.0 :price 3600.0
+                 :duration 12 :active true}
+                {:type :sell :who 1 :what :wheat :amount 10.0 :price 90.0
+                 :duration 3 :active false}]))
+
+(deftest sample-is-nil-before-first-publish
+  (let [path (temp-path)]
+    (shm/writer path)
+    (is (nil? (shm/sample (shm/reader path))))))
+
+(deftest reader-sees-published-vars
+  (let [path (temp-path)
+        w (shm/writer path)
+        rd (shm/reader path)]
+    (shm/publish! w (game-state))
+    (let [{:keys [seq vars]} (shm/sample rd)]
+      (is (= 2 seq))
+      (is (== 12345.0 (vars "gold")))
+      (is (== 500.0 (vars "loan")))
+      (is (== 4.0 (vars "month")))
+      (is (== (get-in (game-state) [:prices :oxen]) (vars "oxPrice"))))))
+
+(deftest reader-sees-active-pending-contracts
+  (let [path (temp-path)
+        w (shm/writer path)]
+    (shm/publish! w (game-state))
+    (is (= [{:type :buy :who 2 :what :oxen :amount 40.0 :price 3600.0
+             :duration 12}]
+           (:pending (shm/sample (shm/reader path)))))))
+
+(deftest reader-sees-phase-timings
+  (let [path (temp-path)
+        w (shm/writer path)
+        times (long-array (count sim/phase-names))]
+    (aset times 0 7)
+    (shm/publish! w (game-state) times)
+    (let [rd (shm/reader path)]
+      (is (= sim/phase-names (:phases rd)))
+      (is (= 7 (get-in (shm/sample rd) [:phase-ns (first sim/phase-names)]))))))
+
+(deftest reader-names-every-var
+  (let [path (temp-path)]
+    (shm/writer path)
+    (is (= (mapv first shm/vars) (:vars (shm/reader path))))))
+
+(deftest concurrent-samples-are-consistent
+  (let [path (temp-path)
+        w (shm/writer path)
+        rd (shm/reader path)
+        done (atom false)
+        f (future
+            (loop [g 1.0]
+              (when-not @done
+                (shm/publish! w (assoc (game-state) :gold g :old-gold g))
+                (recur (inc g)))))]
+    (try
+      (dotimes [_ 2000]
+        (when-let [{:keys [vars]} (shm/sample rd)]
+          (is (== (vars "gold") (vars "oldGold")))))
+      (finally
+        (reset! done true)
+        @f))))
@@ -110,6 +110,12 @@
         result (sim/run-month rng state)]
     (is (:game-won result))))
 
+(deftest run-month-skips-display-converters
+  (let [result (sim/run-month (r/make-rng 42) (game-state))]
+    (is (contains? result :max-wk-sl))
+    (is (not (contains? result :motive)))
+    (is (not (contains? result :ov-eff)))))
+
 (deftest run-month-deterministic
   (let [state (game-state)
         r1 (sim/run-month (r/make-rng 42) state)
@@ -238,3 +244,11 @@
         result (inp/handle-key rng state \space)]
     (is (true? (:quit-clicked result)))
     (is (nil? (:message result)))))
+
+(deftest timed-run-month-matches-untimed
+  (let [state (game-state)
+        times (long-array (count sim/phase-names))
+        timed (binding [sim/*phase-ns* times]
+                (sim/run-month (r/make-rng 42) state))]
+    (is (= (sim/run-month (r/make-rng 42) state) timed))
+    (is (every? #(>= % 0) times))))
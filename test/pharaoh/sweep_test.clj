@@ -0,0 +1,79 @@
+(ns pharaoh.sweep-test
+  (:require [clojure.edn :as edn]
+            [clojure.test :refer :all]
+            [pharaoh.ensemble :as en]
+            [pharaoh.sweep :as sw])
+  (:import [java.io BufferedReader File InputStreamReader OutputStreamWriter]
+           [java.net ServerSocket Socket]
+           [java.util.concurrent ExecutionException]))
+
+(def ^:private spec
+  {:policies ["default" "idle"] :levels ["Easy"] :seeds [1 2 3 4 5] :months 6})
+
+(deftest shards-merge-to-the-single-process-result
+  (let [c (sw/start-coordinator spec {:shard-size 3})
+        workers (doall (for [_ (range 2)]
+                         (future (sw/work "127.0.0.1" (:port c) {:threads 1}))))
+        results (sw/await-results c)]
+    (run! deref workers)
+    (sw/stop! c)
+    (is (= (en/run (assoc spec :threads 2)) results))))
+
+(deftest a-crashed-workers-shard-is-reassigned
+  (let [c (sw/start-coordinator spec {:shard-size 4})]
+    ;; Takes a shard and disconnects without answering.
+    (with-open [s (Socket. "127.0.0.1" (int (:port c)))]
+      (.readLine (BufferedReader. (InputStreamReader. (.getInputStream s)))))
+    (let [w (future (sw/work "127.0.0.1" (:port c) {:threads 2}))
+          results (sw/await-results c)]
+      @w
+      (sw/stop! c)
+      (is (= (range 10) (map :run results)))
+      (is (= (en/run spec) results)))))
+
+(deftest a-shard-whose-answer-is-cut-short-is-reassigned
+  (let [c (sw/start-coordinator spec {:shard-size 4})]
+    ;; Takes a shard and dies halfway through its answer.
+    (with-open [s (Socket. "127.0.0.1" (int (:port c)))]
+      (let [{:keys [shard]} (edn/read-string
+                              (.readLine (BufferedReader. (InputStreamReader. (.getInputStream s)))))
+            out (OutputStreamWriter. (.getOutputStream s))]
+        (.write out (str "{:shard " shard " :results [{:run"))
+        (.flush out)))
+    (let [w (future (sw/work "127.0.0.1" (:port c) {:threads 2}))
+          results (sw/await-results c)]
+      @w
+      (sw/stop! c)
+      (is (= (en/run spec) results)))))
+
+;; A worker the coordinator drops has not finished, so it must not exit
+;; cleanly.
+(deftest a-dropped-worker-fails
+  (with-open [server (ServerSocket. 0)]
+    (let [w (future (sw/work "127.0.0.1" (.getLocalPort server) {:threads 1}))]
+      (.close (.accept server))
+      (is (thrown? ExecutionException @w)))))
+
+;; Shards that take longer than the lease are kept alive by heartbeats.
+(deftest slow-shards-outlive-the-lease
+  (let [run en/run]
+    (with-redefs [en/run (fn [spec] (Thread/sleep 600) (run spec))]
+      (let [c (sw/start-coordinator spec {:shard-size 5 :lease-ms 200})
+            w (future (sw/work "127.0.0.1" (:port c) {:threads 1}))
+            results (sw/await-results c)]
+        (is (nil? @w))
+        (sw/stop! c)
+        (is (= (range 10) (map :run results)))))))
+
+(deftest local-workers-share-progress-slots
+  (let [f (doto (File/createTempFile "pharaoh" ".sweep") (.deleteOnExit))
+        buf (sw/create-progress (.getPath f) 2)
+        c (sw/start-coordinator spec {:shard-size 2})
+        workers (doall (for [slot (range 2)]
+                         (future (sw/work "127.0.0.1" (:port c)
+                                          {:threads 1 :progress (.getPath f) :slot slot}))))
+        results (sw/await-results c)]
+    (run! deref workers)
+    (sw/stop! c)
+    (is (= {:shards 5 :runs 10 :months (reduce + (map :months results))}
+           (select-keys (sw/progress buf) [:shards :runs :months])))))
@@ -147,3 +147,11 @@
 (deftest repay-index-table-matches-original
   (is (== 1.0 (t/interpolate 0.0 t/repay-index)))
   (is (== 1.3 (t/interpolate 0.1 t/repay-index))))
+
+(deftest slope-is-the-segment-gradient
+  (let [t (t/make-table 0.0 10.0 [0.0 1.0 4.0 3.0 4.0 5.0 6.0 7.0 8.0 9.0 10.0])]
+    (is (== 1.0 (t/slope 0.5 t)))
+    (is (== 3.0 (t/slope 1.5 t)))
+    (is (== -1.0 (t/slope 2.5 t)))
+    (is (== 0.0 (t/slope -1.0 t)))
+    (is (== 0.0 (t/slope 11.0 t)))))
@@ -0,0 +1,63 @@
+(ns pharaoh.telemetry-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.telemetry :as tm])
+  (:import [java.io File]))
+
+(defn- temp-path []
+  (let [f (File/createTempFile "pharaoh" ".ptl")]
+    (.deleteOnExit f)
+    (.getPath f)))
+
+(def ^:private columns [["gold" [:gold]] ["wtPrice" [:prices :wheat]] ["banker" [:banker]]])
+
+(defn- state [run m]
+  {:year (quot m 12) :month (mod m 12) :gold (+ (* 1000.0 run) m)
+   :prices {:wheat (* 0.5 m)} :banker "Ptolemy"})
+
+(deftest rows-from-many-threads-read-back
+  (let [path (temp-path)
+        w (tm/open-writer path columns {:rows 16 :max-buffers 12})
+        workers (for [run (range 4)]
+                  (future (doseq [m (range 37)] (tm/record! w run (state run m)))))]
+    (run! deref (doall workers))
+    (tm/close! w)
+    (let [{:keys [run month values] :as data} (tm/read-file path)
+          rows (sort (map vector (seq run) (seq month) (seq (values "gold"))))]
+      (is (= ["gold" "wtPrice" "banker"] (:columns data)))
+      (is (= (* 4 37) (count rows)))
+      (is (= (for [r (range 4) m (range 37)] [r m (+ (* 1000.0 r) m)]) rows))
+      (is (every? #(Double/isNaN %) (values "banker"))))))
+
+(deftest empty-writer-has-only-a-header
+  (let [path (temp-path)]
+    (tm/close! (tm/open-writer path columns))
+    (is (zero? (count (:run (tm/read-file path)))))))
+
+;; A failing write must surface on the recording threads rather than
+;; leave them waiting for a buffer that never comes back.
+(deftest failed-writes-are-reported-to-recorders
+  (let [w (tm/open-writer (temp-path) columns {:rows 2 :max-buffers 2})
+        _ (.close ^java.nio.channels.FileChannel (:channel w))
+        outcome (deref (future (try (dotimes [m 10000] (tm/record! w 0 (state 0 m)))
+                                    :recorded
+                                    (catch clojure.lang.ExceptionInfo _ :thrown)))
+                       10000 :hung)]
+    (is (= :thrown outcome))
+    (is (thrown? clojure.lang.ExceptionInfo (tm/close! w)))))
+
+(deftest append-keeps-earlier-chunks
+  (let [path (temp-path)
+        write (fn [opts ms]
+                (let [w (tm/open-writer path columns (merge {:rows 4} opts))]
+                  (doseq [m ms] (tm/record! w 0 (state 0 m)))
+                  (tm/close! w)))]
+    (write {} (range 10))
+    ;; A chunk cut short by a crash is dropped on reopening.
+    (with-open [out (java.io.FileOutputStream. ^String path true)]
+      (.write out (byte-array [2 0 0 0 100 0 0 0 1 2 3])))
+    (write {:append true} (range 10 15))
+    (is (= (range 15) (seq (:month (tm/read-file path)))))
+    (is (thrown? clojure.lang.ExceptionInfo
+                 (tm/open-writer path [["gold" [:gold]]] {:append true})))
+    (write {} [20])
+    (is (= [20] (seq (:month (tm/read-file path)))))))
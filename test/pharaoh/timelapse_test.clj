@@ -0,0 +1,25 @@
+(ns pharaoh.timelapse-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.random :as r]
+            [pharaoh.timelapse :as tl]
+            [pharaoh.ui.layout :as lay])
+  (:import [java.io ByteArrayOutputStream]))
+
+(deftest record-writes-a-frame-per-month
+  (let [frames (atom [])
+        rng (r/make-rng 42)
+        state (tl/new-game rng "Normal")
+        end (tl/record rng state 3 {:write (fn [_ i] (swap! frames conj i))})]
+    (is (= [0 1 2 3] @frames))
+    (is (= 3 (+ (* 12 (- (:year end) (:year state)))
+                (- (:month end) (:month state)))))))
+
+(deftest ppm-frames-are-header-plus-rgb
+  (let [out (ByteArrayOutputStream.)
+        rng (r/make-rng 42)
+        sink (tl/ppm-sink out)
+        header (count (format "P6\n%d %d\n255\n" lay/win-w lay/win-h))]
+    (tl/record rng (tl/new-game rng "Normal") 1 sink)
+    ((:close sink))
+    (is (= (* 2 (+ header (* 3 lay/win-w lay/win-h))) (.size out)))
+    (is (= "P6" (String. (.toByteArray out) 0 2 "US-ASCII")))))
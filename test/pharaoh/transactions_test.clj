@@ -0,0 +1,116 @@
+(ns pharaoh.transactions-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.random :as r]
+            [pharaoh.state :as st]
+            [pharaoh.trading :as tr]
+            [pharaoh.transactions :as tx]
+            [pharaoh.ui.dialogs :as dlg]))
+
+(defn- game-state []
+  (assoc (st/initial-state)
+    :gold 100000.0 :wheat 5000.0 :slaves 50.0 :oxen 20.0 :horses 10.0
+    :ln-fallow 100.0 :overseers 3.0 :loan 0.0 :credit-limit 50000.0))
+
+(deftest buy-matches-trading-buy
+  (let [state (game-state)
+        {s :state r :result} (tx/apply-order (r/make-rng 42) state
+                                             {:op :buy :commodity :oxen :amount 5})]
+    (is (= {:status :ok :amount 5} r))
+    (is (= (tr/buy (r/make-rng 42) state :oxen 5) s))))
+
+(deftest buy-beyond-gold-is-refused
+  (let [state (assoc (game-state) :gold 10.0)
+        {s :state r :result} (tx/apply-order (r/make-rng 42) state
+                                             {:op :buy :commodity :slaves :amount 5})]
+    (is (= :insufficient-funds (:reason r)))
+    (is (= state s))))
+
+(deftest buy-beyond-supply-is-capped
+  (let [state (assoc-in (game-state) [:supply :horses] 3.0)
+        {s :state r :result} (tx/apply-order (r/make-rng 42) state
+                                             {:op :buy :commodity :horses :amount 5})]
+    (is (= :capped (:status r)))
+    (is (== 3.0 (:amount r)))
+    (is (== 13.0 (:horses s)))))
+
+(deftest selling-more-than-owned-is-refused
+  (let [{r :result} (tx/apply-order (r/make-rng 42) (game-state)
+                                    {:op :sell :commodity :oxen :amount 500})]
+    (is (= :not-owned (:reason r)))
+    (is (== 20.0 (:max-amount r)))))
+
+(deftest borrow-past-limit-needs-credit-check
+  (let [{s :state r :result} (tx/apply-order (r/make-rng 42) (game-state)
+                                             {:op :borrow :amount 60000})]
+    (is (= :needs-credit-check (:reason r)))
+    (is (pos? (:fee r)))
+    (is (== 0.0 (:loan s)))))
+
+(deftest borrow-with-credit-check-goes-to-the-banker
+  (let [{r :result} (tx/apply-order (r/make-rng 42) (game-state)
+                                    {:op :borrow :amount 60000 :credit-check true})]
+    (is (#{:ok :error} (:status r)))
+    (is (not= :needs-credit-check (:reason r)))))
+
+(deftest firing-too-many-overseers-is-refused
+  (let [{s :state r :result} (tx/apply-order (r/make-rng 42) (game-state)
+                                             {:op :fire :amount 5})]
+    (is (= :too-many (:reason r)))
+    (is (== 3.0 (:overseers s)))))
+
+(deftest standing-orders-set-rates
+  (let [{s :state} (tx/apply-orders (r/make-rng 42) (game-state)
+                                    [{:op :feed :commodity :oxen :amount 60}
+                                     {:op :plant :amount 25}
+                                     {:op :quota :amount 8}])]
+    (is (== 60 (:ox-feed-rt s)))
+    (is (== 25 (:ln-to-sew s)))
+    (is (== 8 (:py-quota s)))))
+
+(deftest malformed-orders-are-skipped
+  (let [{s :state results :results}
+        (tx/apply-orders (r/make-rng 42) (game-state)
+                         [{:op :steal :amount 1}
+                          {:op :buy :commodity :oxen :amount -1}
+                          {:op :buy :commodity :gems :amount 1}
+                          {:op :hire :amount 2}])]
+    (is (= [:unknown-op :invalid-amount :unknown-commodity]
+           (map :reason (take 3 results))))
+    (is (= :ok (:status (last results))))
+    (is (== 5.0 (:overseers s)))))
+
+(deftest batch-replays-one-order-at-a-time
+  (let [orders [{:op :buy :commodity :slaves :amount 10}
+                {:op :sell :commodity :wheat :amount 100}
+                {:op :buy :commodity :horses :amount 2}
+                {:op :borrow :amount 1000}]
+        rng (r/make-rng 7)
+        one-by-one (reduce (fn [s o] (:state (tx/apply-order rng s o)))
+                           (game-state) orders)]
+    (is (= one-by-one
+           (:state (tx/apply-orders (r/make-rng 7) (game-state) orders))))))
+
+;; A refused order and a credit-checked loan draw the dialog's message,
+;; so the rng is where the dialog would leave it.
+(deftest orders-draw-as-the-dialogs-do
+  (let [broke (-> (assoc (game-state) :gold 10.0)
+                  (dlg/open-dialog :buy-sell {:commodity :slaves :mode :buy :input "5"}))
+        by-dialog (r/make-rng 42)
+        by-order (r/make-rng 42)
+        shown (:message (dlg/execute-dialog by-dialog broke))
+        {r :result} (tx/apply-order by-order (dissoc broke :dialog)
+                                    {:op :buy :commodity :slaves :amount 5})]
+    (is (= shown (:message r)))
+    (is (= (.nextDouble by-dialog) (.nextDouble by-order))))
+  (let [by-dialog (r/make-rng 42)
+        by-order (r/make-rng 42)
+        asked (-> (game-state)
+                  (dlg/open-dialog :loan {:mode :borrow :input "60000"})
+                  (->> (dlg/execute-dialog by-dialog)))
+        answered (dlg/accept-credit-check by-dialog asked)
+        {s :state r :result} (tx/apply-order by-order (game-state)
+                                             {:op :borrow :amount 60000 :credit-check true})]
+    (is (= :credit-check (get-in asked [:dialog :mode])))
+    (is (= (:text (:message answered)) (:message r)))
+    (is (= (dissoc answered :message) s))
+    (is (= (.nextDouble by-dialog) (.nextDouble by-order)))))
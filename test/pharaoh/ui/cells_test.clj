@@ -0,0 +1,37 @@
+(ns pharaoh.ui.cells-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.ui.cells :as cells]))
+
+(defn- counting-fmt [calls]
+  (fn [x] (swap! calls inc) (format "%.0f" (double x))))
+
+(defn- specs [calls]
+  [{:cell [1 1] :read :wheat :fmt (counting-fmt calls)}
+   {:cell [1 2] :read :gold :fmt (counting-fmt calls)}])
+
+(deftest first-refresh-formats-and-dirties-every-cell
+  (let [calls (atom 0)
+        {:keys [model dirty]} (cells/refresh cells/empty-model (specs calls)
+                                             {:wheat 10.0 :gold 5.0})]
+    (is (= #{[1 1] [1 2]} dirty))
+    (is (= 2 @calls))
+    (is (= "10" (cells/text model [1 1])))))
+
+(deftest unchanged-values-are-not-reformatted
+  (let [calls (atom 0)
+        sp (specs calls)
+        {:keys [model]} (cells/refresh cells/empty-model sp {:wheat 10.0 :gold 5.0})
+        _ (reset! calls 0)
+        {:keys [dirty]} (cells/refresh model sp {:wheat 10.0 :gold 5.0})]
+    (is (empty? dirty))
+    (is (zero? @calls))))
+
+(deftest changed-value-with-same-text-is-not-dirty
+  (let [calls (atom 0)
+        sp (specs calls)
+        {:keys [model]} (cells/refresh cells/empty-model sp {:wheat 10.0 :gold 5.0})
+        _ (reset! calls 0)
+        {:keys [model dirty]} (cells/refresh model sp {:wheat 10.2 :gold 6.0})]
+    (is (= #{[1 2]} dirty))
+    (is (= 2 @calls))
+    (is (= "6" (cells/text model [1 2])))))
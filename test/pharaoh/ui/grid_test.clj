@@ -1,11 +1,11 @@
-(ns pharaoh.ui.screen-test
+(ns pharaoh.ui.grid-test
   (:require [clojure.test :refer :all]
-            [pharaoh.ui.screen]))
+            [pharaoh.ui.grid]))
 
 ;; Access private functions via var references
-(def delta-pct #'pharaoh.ui.screen/delta-pct)
-(def fmt #'pharaoh.ui.screen/fmt)
-(def fmt1 #'pharaoh.ui.screen/fmt1)
+(def delta-pct #'pharaoh.ui.grid/delta-pct)
+(def fmt #'pharaoh.ui.grid/fmt)
+(def fmt1 #'pharaoh.ui.grid/fmt1)
 
 ;; ---- fmt ----
 
@@ -82,7 +82,7 @@
 
 ;; ---- fmt-pending ----
 
-(def fmt-pending #'pharaoh.ui.screen/fmt-pending)
+(def fmt-pending #'pharaoh.ui.grid/fmt-pending)
 
 (deftest fmt-pending-buy-with-months-left
   (let [c {:type :buy :amount 100.0 :what :wheat
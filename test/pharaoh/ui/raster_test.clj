@@ -0,0 +1,38 @@
+(ns pharaoh.ui.raster-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.contracts :as ct]
+            [pharaoh.random :as r]
+            [pharaoh.state :as st]
+            [pharaoh.ui.layout :as lay]
+            [pharaoh.ui.raster :as ras]))
+
+(defn- game-state []
+  (assoc (st/initial-state)
+    :gold 100000.0 :wheat 5000.0 :old-wheat 5000.0 :slaves 50.0
+    :players (ct/make-players (r/make-rng 1))))
+
+(defn- snapshot [canvas] (vec (ras/pixels canvas)))
+
+(defn- pixel [canvas x y]
+  (bit-and 0xffffff (aget (ras/pixels canvas) (+ (int x) (* (int y) (ras/width canvas))))))
+
+(deftest renders-the-window-sized-layout
+  (let [canvas (ras/render (ras/make-canvas) (game-state))
+        {:keys [x y]} (lay/cell-rect-span 0 0 4 8)]
+    (is (= lay/win-w (ras/width canvas)))
+    (is (= lay/win-h (ras/height canvas)))
+    (is (= 0xffffff (pixel canvas 0 0)))
+    (is (= 0xa0a0a0 (pixel canvas x (+ y 5))) "section frame")))
+
+(deftest unchanged-state-leaves-pixels-alone
+  (let [state (game-state)
+        canvas (ras/render (ras/make-canvas) state)
+        before (snapshot canvas)]
+    (is (= before (snapshot (ras/render canvas state))))))
+
+(deftest incremental-frame-matches-a-full-frame
+  (let [a (game-state)
+        b (assoc a :wheat 6000.0 :gold 90000.0)
+        incremental (-> (ras/make-canvas) (ras/render a) (ras/render b))
+        full (ras/render (ras/make-canvas) b)]
+    (is (= (snapshot full) (snapshot incremental)))))
@@ -0,0 +1,57 @@
+(ns pharaoh.valuation-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.state :as st]
+            [pharaoh.valuation :as va]))
+
+(def ^:private reliable {:pay-k 1.0 :ship-k 1.0 :default-k 1.0})
+(def ^:private flaky {:pay-k 1.0 :ship-k 1.0 :default-k 0.5})
+
+(defn- offer [who & {:as kv}]
+  (merge {:type :buy :who who :what :wheat :amount 100.0 :price 1000.0
+          :duration 12 :active true}
+         kv))
+
+(defn- state [offers]
+  (assoc (st/initial-state)
+    :players [reliable flaky]
+    :cont-offers offers
+    :inflation 0.0))
+
+(deftest reliable-buyer-never-defaults
+  (let [o (offer 0)
+        v (va/value (va/revalue (va/empty-cache 1) (state [o])) o)]
+    (is (zero? (:default-risk v)))
+    (is (<= (:p10 v) (:p50 v) (:p90 v)))))
+
+(deftest flaky-buyer-usually-defaults
+  (let [o (offer 1)
+        v (va/value (va/revalue (va/empty-cache 1) (state [o])) o)]
+    (is (> (:default-risk v) 0.9))
+    (is (< (Math/abs (- (:ev v) 50.0)) 10.0))))
+
+(deftest overpriced-buy-has-positive-value
+  ;; 100 wheat at 2 gold for 1000 gold
+  (let [o (offer 0)
+        v (va/value (va/revalue (va/empty-cache 1) (state [o])) o)]
+    (is (> (:ev v) 500.0))))
+
+(deftest aged-offer-reuses-its-draws
+  (let [o (offer 0)
+        c1 (va/revalue (va/empty-cache 1) (state [o]))
+        aged (assoc o :duration 11 :price 1050.0)
+        c2 (va/revalue c1 (state [aged]))]
+    (is (identical? (first (vals (:draws c1))) (first (vals (:draws c2)))))
+    (is (not= (va/value c1 o) (va/value c2 aged)))))
+
+(deftest unchanged-offer-keeps-its-summary
+  (let [o (offer 0)
+        c1 (va/revalue (va/empty-cache 1) (state [o]))
+        c2 (va/revalue c1 (state [o]))]
+    (is (identical? (va/value c1 o) (va/value c2 o)))))
+
+(deftest withdrawn-offers-are-dropped
+  (let [c (-> (va/empty-cache 1)
+              (va/revalue (state [(offer 0) (offer 1 :what :oxen)]))
+              (va/revalue (state [(offer 0)])))]
+    (is (= 1 (count (:draws c))))
+    (is (nil? (va/value c (offer 1 :what :oxen))))))
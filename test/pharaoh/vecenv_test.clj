@@ -0,0 +1,54 @@
+(ns pharaoh.vecenv-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.shm :as shm]
+            [pharaoh.vecenv :as ve]))
+
+(def ^:private gold-col
+  (.indexOf ^java.util.List (mapv first shm/vars) "gold"))
+
+(def ^:private oxen-col
+  (.indexOf ^java.util.List (mapv first shm/vars) "oxen"))
+
+(defn- buffers [n]
+  {:actions (ve/direct-buffer (* n ve/action-dim))
+   :obs (ve/direct-buffer (* n ve/obs-dim))
+   :rewards (ve/direct-buffer n)
+   :dones (ve/direct-buffer n)})
+
+(defn- no-op! [actions n]
+  (dotimes [i (* n ve/action-dim)]
+    (.put actions (int i) Double/NaN)))
+
+(defn- run [threads seeds steps]
+  (let [n (count seeds)
+        env (ve/make-env n {:threads threads :difficulty "Easy"})
+        {:keys [actions obs rewards dones]} (buffers n)]
+    (try
+      (ve/reset-games! env (long-array seeds) obs)
+      (no-op! actions n)
+      (.put actions (int 8) 5.0) ; game 0 buys five oxen
+      (dotimes [_ steps]
+        (ve/step! env actions obs rewards dones))
+      {:states (mapv #(ve/state-of env %) (range n))
+       :obs (let [a (double-array (* n ve/obs-dim))] (.get (.duplicate obs) a) (vec a))}
+      (finally (ve/close env)))))
+
+(deftest reset-writes-each-game-observation
+  (let [env (ve/make-env 2 {:threads 2})
+        obs (ve/direct-buffer (* 2 ve/obs-dim))]
+    (try
+      (ve/reset-games! env (long-array [1 2]) obs)
+      (is (== (:gold (ve/state-of env 1))
+              (.get obs (int (+ ve/obs-dim gold-col)))))
+      (finally (ve/close env)))))
+
+(deftest actions-are-applied-before-the-month
+  (let [{:keys [states]} (run 1 [42 42] 1)]
+    (is (> (:oxen (first states)) (:oxen (second states))))))
+
+(deftest results-do-not-depend-on-thread-count
+  (is (= (:states (run 1 [5 6 7 8] 3)) (:states (run 3 [5 6 7 8] 3)))))
+
+(deftest observation-tracks-state
+  (let [{:keys [states obs]} (run 2 [9 10] 2)]
+    (is (== (:oxen (second states)) (obs (+ ve/obs-dim oxen-col))))))
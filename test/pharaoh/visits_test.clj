@@ -154,3 +154,14 @@
     (is (some? m))
     (is (map? m))
     (is (string? (:text m)))))
+
+;; --- next-visit ---
+
+(deftest next-visit-is-earliest-deadline
+  (let [app (make-app :next-idle 1500 :next-chat 1200 :next-dunning 900)]
+    (is (= 1200 (v/next-visit app 0)))
+    (is (= 900 (v/next-visit (assoc-in app [:state :loan] 100.0) 0)))))
+
+(deftest next-visit-waits-behind-a-message
+  (let [app (assoc-in (make-app) [:state :message] {:text "hi" :face 0})]
+    (is (nil? (v/next-visit app 0)))))
@@ -0,0 +1,58 @@
+(ns pharaoh.world-test
+  (:require [clojure.test :refer :all]
+            [pharaoh.world :as w])
+  (:import [java.util.concurrent ForkJoinPool]))
+
+(defn- run-on [threads world months]
+  (let [pool (ForkJoinPool. threads)]
+    (try
+      (nth (iterate #(w/step % pool) world) months)
+      (finally (.shutdown pool)))))
+
+(deftest market-is-shared-by-every-kingdom
+  (let [world (w/step (w/make-world 4 7))
+        prices (get-in world [:market :prices])]
+    (is (= 1 (:month world)))
+    (is (every? #(= prices (get-in % [:state :prices])) (:kingdoms world)))))
+
+(deftest results-do-not-depend-on-the-pool
+  (let [a (run-on 1 (w/make-world 6 11) 3)
+        b (run-on 4 (w/make-world 6 11) 3)]
+    (is (= (:market a) (:market b)))
+    (is (= (:book a) (:book b)))
+    (is (= (map :state (:kingdoms a)) (map :state (:kingdoms b))))))
+
+(deftest purchases-draw-down-shared-supply
+  (let [world (w/make-world 2 3 {:difficulty "Easy"})
+        policy (fn [_] [{:op :buy :commodity :horses :amount 5}])
+        world (update world :kingdoms (fn [ks] (mapv #(assoc % :policy policy) ks)))
+        stepped (w/step world)]
+    (is (== 10.0 (get-in stepped [:net :horses])))))
+
+(deftest market-scales-with-kingdoms
+  (let [one (w/make-world 1 5)
+        ten (w/make-world 10 5)]
+    (is (== (* 10 (get-in one [:market :demand :wheat]))
+            (get-in ten [:market :demand :wheat])))))
+
+(deftest standings-rank-by-pyramid
+  (let [s (w/standings (w/step (w/make-world 3 2)))]
+    (is (= 3 (count s)))
+    (is (apply >= (map :py-height s)))))
+
+(deftest accepted-contracts-settle-against-their-kingdom
+  (let [world (w/make-world 3 4 {:difficulty "Easy" :accept (constantly true)})
+        worlds (take 40 (iterate w/step world))
+        kinds (frequencies (mapcat #(map :kind (:contract-events %)) worlds))]
+    (is (pos? (+ (get kinds :due 0) (get kinds :default 0))))
+    (is (every? #(< -1 (:kingdom %) 3) (vals (:contracts (:book (last worlds))))))))
+
+(deftest declined-offers-are-only-withdrawn
+  (let [world (w/make-world 2 4 {:accept (constantly false)})
+        worlds (take 30 (iterate w/step world))]
+    (is (= #{:withdrawn} (set (mapcat #(map :kind (:contract-events %)) worlds))))
+    (is (every? #(= :offer (:status %)) (vals (:contracts (:book (last worlds))))))))
+
+(deftest contract-book-has-no-fixed-caps
+  (let [world (w/step (w/make-world 2 4 {:traders 500 :offers 200}))]
+    (is (< 100 (count (:contracts (:book world)))))))